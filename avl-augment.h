@@ -0,0 +1,129 @@
+#ifndef AVL_AUGMENT_H
+#define AVL_AUGMENT_H
+
+#include <cstddef>
+#include <limits>
+
+/**
+* Augmentation policies for AVLTree.
+*
+* An augmentation is a monoid over the tree's pairs. Every AVLNode stores the
+* combination, in key order, of the values lifted from each pair in its
+* subtree, and the tree keeps those up to date through inserts, removals and
+* rotations. A policy provides:
+*
+*   typedef ... value_type;
+*   static const bool enabled;                       // false only for NoAugment
+*   static const bool readsValue;                    // lift looks at the value
+*                                                    // (optional, see below)
+*   static value_type lift(const Key&, const Value&);
+*   static value_type identity();
+*   static value_type combine(const value_type& left, const value_type& right);
+*
+* combine must be associative with identity as its neutral element. A policy
+* that also has
+*
+*   static std::size_t count(const value_type&);     // pairs in the subtree
+*
+* turns on AVLTree's order statistics (size, rank, select, countRange).
+* Any policy can be queried over a key range with AVLTree::rangeQuery.
+*
+* A value written in place would not reach the stored augments, so a tree
+* whose policy reads the value hands out only read-only iterators and
+* operator[]. Its values are changed with insert or insert_or_assign, which
+* update the augments on the way back to the root. A policy that does not
+* declare readsValue is taken to read the value if it is enabled.
+*/
+
+template<typename Augment, typename = void>
+struct AugmentReadsValue
+{
+    static const bool value = Augment::enabled;
+};
+
+template<typename Augment>
+struct AugmentReadsValue<Augment, decltype((void)Augment::readsValue)>
+{
+    static const bool value = Augment::readsValue;
+};
+
+/**
+* The default: nothing is stored and all of the bookkeeping compiles away.
+*/
+struct NoAugment
+{
+    struct value_type { };
+    static const bool enabled = false;
+    static const bool readsValue = false;
+
+    template<typename Key, typename Value>
+    static value_type lift(const Key&, const Value&) { return value_type(); }
+    static value_type identity() { return value_type(); }
+    static value_type combine(const value_type&, const value_type&) { return value_type(); }
+};
+
+/**
+* Subtree sizes, for O(log n) order statistics.
+*/
+struct OrderStatistics
+{
+    typedef std::size_t value_type;
+    static const bool enabled = true;
+    static const bool readsValue = false;
+
+    template<typename Key, typename Value>
+    static value_type lift(const Key&, const Value&) { return 1; }
+    static value_type identity() { return 0; }
+    static value_type combine(const value_type& left, const value_type& right) { return left + right; }
+    static std::size_t count(const value_type& v) { return v; }
+};
+
+/**
+* Sum of the values, e.g. AVLTree<K, int, NodePool, ValueSum<int> >.
+*/
+template<typename T>
+struct ValueSum
+{
+    typedef T value_type;
+    static const bool enabled = true;
+    static const bool readsValue = true;
+
+    template<typename Key>
+    static value_type lift(const Key&, const T& value) { return value; }
+    static value_type identity() { return T(); }
+    static value_type combine(const value_type& left, const value_type& right) { return left + right; }
+};
+
+/**
+* Smallest value; an empty range gives the largest T.
+*/
+template<typename T>
+struct ValueMin
+{
+    typedef T value_type;
+    static const bool enabled = true;
+    static const bool readsValue = true;
+
+    template<typename Key>
+    static value_type lift(const Key&, const T& value) { return value; }
+    static value_type identity() { return std::numeric_limits<T>::max(); }
+    static value_type combine(const value_type& left, const value_type& right) { return right < left ? right : left; }
+};
+
+/**
+* Largest value; an empty range gives the lowest T.
+*/
+template<typename T>
+struct ValueMax
+{
+    typedef T value_type;
+    static const bool enabled = true;
+    static const bool readsValue = true;
+
+    template<typename Key>
+    static value_type lift(const Key&, const T& value) { return value; }
+    static value_type identity() { return std::numeric_limits<T>::lowest(); }
+    static value_type combine(const value_type& left, const value_type& right) { return left < right ? right : left; }
+};
+
+#endif
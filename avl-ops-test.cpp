@@ -0,0 +1,764 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <random>
+#include <stdexcept>
+#include <cstdlib>
+#include <thread>
+#include "avlbst.h"
+
+using namespace std;
+
+// Checks AVLTree's whole-tree operations, order statistics and range
+// queries against std::map.
+// Run with: ./avl-ops-test [rounds]
+//
+// Every operation is followed by verify(), which checks the parent links,
+// key order, balance factors and cached height of the whole tree, and by a
+// comparison of the contents with a std::map that went through the same
+// changes.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+template<typename Tree>
+static bool same(const Tree& t, const map<int, int>& m)
+{
+    map<int, int>::const_iterator e = m.begin();
+    for (typename Tree::iterator it = t.begin(); it != t.end(); ++it, ++e) {
+        if (e == m.end() || e->first != it->first || e->second != it->second) return false;
+    }
+    if (e != m.end()) return false;
+    // the cached smallest and largest nodes
+    return m.empty() || (t.begin()->first == m.begin()->first && t.rbegin()->first == m.rbegin()->first);
+}
+
+// ceil(log2(n + 1)), the height of the shortest tree with n nodes
+static int minHeight(size_t n)
+{
+    int height = 0;
+    while (n > 0) {
+        height++;
+        n /= 2;
+    }
+    return height;
+}
+
+static void testBuild()
+{
+    size_t sizes[] = { 0, 1, 2, 3, 4, 7, 8, 15, 16, 31, 32, 1023, 1024, 4095, 4096 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t n = sizes[i];
+        vector< pair<int, int> > items;
+        map<int, int> m;
+        for (size_t k = 0; k < n; k++) {
+            items.push_back(make_pair((int)k * 3, (int)k));
+            m[(int)k * 3] = (int)k;
+        }
+
+        AVLTree<int, int> built(items.begin(), items.end());
+        check(same(built, m), "range constructor contents");
+        check(built.verify(), "range constructor verify");
+        check(built.height() == minHeight(n), "range constructor height");
+
+        // buildFromSorted replaces whatever was there
+        AVLTree<int, int> rebuilt;
+        for (int k = 0; k < 10; k++) rebuilt.insert(make_pair(-k, k));
+        rebuilt.buildFromSorted(items.begin(), items.end());
+        check(same(rebuilt, m), "buildFromSorted contents");
+        check(rebuilt.verify(), "buildFromSorted verify");
+        check(rebuilt.height() == minHeight(n), "buildFromSorted height");
+
+        // and the result is an ordinary tree afterwards
+        rebuilt.insert(make_pair(-1, -1));
+        rebuilt.remove(0);
+        m[-1] = -1;
+        m.erase(0);
+        check(same(rebuilt, m) && rebuilt.verify(), "insert and remove after a build");
+    }
+
+    // keys out of order or repeated throw, leaving the tree empty
+    int bad[][3] = { { 1, 3, 2 }, { 1, 2, 2 } };
+    for (int i = 0; i < 2; i++) {
+        vector< pair<int, int> > items;
+        for (int k = 0; k < 3; k++) items.push_back(make_pair(bad[i][k], k));
+        AVLTree<int, int> t;
+        t.insert(make_pair(5, 5));
+        bool threw = false;
+        try {
+            t.buildFromSorted(items.begin(), items.end());
+        }
+        catch (const invalid_argument&) {
+            threw = true;
+        }
+        check(threw, "buildFromSorted rejects unsorted keys");
+        check(t.empty() && t.height() == 0 && t.verify(), "tree empty after a rejected build");
+    }
+    cout << "bulk builds" << endl;
+}
+
+// Exposes which of the two insertBatch/removeBatch paths a batch takes.
+class BatchProbe : public AVLTree<int, int>
+{
+public:
+    bool smallInsert(size_t k) const { return smallBatch(k, INSERT_BATCH_SHIFT); }
+    bool smallRemove(size_t k) const { return smallBatch(k, REMOVE_BATCH_SHIFT); }
+};
+
+// random keys from [0, range), sorted and without repeats
+static vector<int> sortedSample(mt19937& rng, size_t k, int range)
+{
+    map<int, int> picked;
+    while (picked.size() < k) picked[(int)(rng() % range)] = 0;
+    vector<int> keys;
+    for (map<int, int>::iterator it = picked.begin(); it != picked.end(); ++it) keys.push_back(it->first);
+    return keys;
+}
+
+static void testBatch(int rounds)
+{
+    mt19937 rng(5);
+    bool sawSmall[2] = { false, false }, sawLarge[2] = { false, false };
+    for (int round = 0; round < rounds; round++) {
+        BatchProbe t;
+        map<int, int> m;
+        int range = 40000;
+        for (int i = 0; i < 10000; i++) {
+            int key = (int)(rng() % range);
+            t.insert(make_pair(key, i));
+            m[key] = i;
+        }
+
+        // batch sizes from one key up to more keys than the tree holds,
+        // stepping through them out of order so a few rounds see both ends
+        size_t k = (size_t)1 << (round * 7 % 15);
+        vector<int> keys = sortedSample(rng, k, range);
+        vector< pair<int, int> > items;
+        for (size_t i = 0; i < keys.size(); i++) {
+            items.push_back(make_pair(keys[i], -(int)i));
+            m[keys[i]] = -(int)i;
+        }
+        (t.smallInsert(k) ? sawSmall[0] : sawLarge[0]) = true;
+        t.insertBatch(items.begin(), items.end());
+        check(same(t, m) && t.verify(), "insertBatch");
+
+        keys = sortedSample(rng, k, range);
+        for (size_t i = 0; i < keys.size(); i++) m.erase(keys[i]);
+        (t.smallRemove(k) ? sawSmall[1] : sawLarge[1]) = true;
+        t.removeBatch(keys.begin(), keys.end());
+        check(same(t, m) && t.verify(), "removeBatch");
+        check(t.begin() == t.end() || (t.begin()->first == m.begin()->first), "smallest key after batches");
+    }
+    check(sawSmall[0] && sawLarge[0], "insertBatch took both paths");
+    check(sawSmall[1] && sawLarge[1], "removeBatch took both paths");
+
+    // batches into an empty tree, and removing everything
+    BatchProbe t;
+    vector< pair<int, int> > items;
+    vector<int> keys;
+    for (int k = 0; k < 1000; k++) {
+        items.push_back(make_pair(k, k));
+        keys.push_back(k);
+    }
+    t.insertBatch(items.begin(), items.end());
+    check(t.verify() && t.height() == minHeight(items.size()), "insertBatch into an empty tree");
+    t.removeBatch(keys.begin(), keys.end());
+    check(t.empty() && t.height() == 0 && t.verify(), "removeBatch of every key");
+
+    // an unsorted batch throws before changing anything, on either path
+    for (int i = 0; i < 1000; i++) t.insert(make_pair(i, i));
+    int unsorted[] = { 5, 7, 6 };
+    bool threw = false;
+    try {
+        t.removeBatch(unsorted, unsorted + 3);
+    }
+    catch (const invalid_argument&) {
+        threw = true;
+    }
+    check(threw && t.find(5) != t.end(), "removeBatch rejects unsorted keys");
+    cout << rounds << " rounds of batches" << endl;
+}
+
+// A value whose copies start throwing once copiesLeft runs out, and that
+// counts the live ones so leaked nodes show up.
+struct Fragile {
+    static int copiesLeft;
+    static int live;
+    int v;
+
+    Fragile(int v) : v(v) { live++; }
+    Fragile(const Fragile& other) : v(other.v)
+    {
+        countCopy();
+        live++;
+    }
+    Fragile& operator=(const Fragile& other)
+    {
+        countCopy();
+        v = other.v;
+        return *this;
+    }
+    ~Fragile() { live--; }
+    static void countCopy()
+    {
+        if (copiesLeft == 0) throw runtime_error("copy failed");
+        if (copiesLeft > 0) copiesLeft--;
+    }
+};
+int Fragile::copiesLeft = -1;
+int Fragile::live = 0;
+
+ostream& operator<<(ostream& out, const Fragile& f)
+{
+    return out << f.v;
+}
+
+// insertBatch creates every node before relinking anything, so a copy that
+// throws part way leaves the tree whole, with each key holding its old
+// value or the batch's, and frees what it made
+static void testBatchThrows()
+{
+    typedef AVLTree<int, Fragile> FragileTree;
+    int throwAt[] = { 0, 1, 7, 300, 1000, 1999 };
+    for (int i = 0; i < 6; i++) {
+        {
+            FragileTree t;
+            for (int k = 0; k < 2000; k += 2) t.insert(make_pair(k, Fragile(k)));
+            // every key from 0 to 1999: half overwrites, half new nodes
+            vector< pair<int, Fragile> > items;
+            for (int k = 0; k < 2000; k++) items.push_back(make_pair(k, Fragile(-k)));
+            int before = Fragile::live;
+            bool threw = false;
+            Fragile::copiesLeft = throwAt[i];
+            try {
+                t.insertBatch(items.begin(), items.end());
+            }
+            catch (const runtime_error&) {
+                threw = true;
+            }
+            Fragile::copiesLeft = -1;
+            check(threw, "insertBatch passes on the exception");
+            check(Fragile::live == before, "insertBatch frees the nodes it made before the throw");
+            bool whole = t.verify();
+            int k = 0;
+            for (FragileTree::iterator it = t.begin(); it != t.end(); ++it, k += 2) {
+                whole = whole && it->first == k && (it->second.v == k || it->second.v == -k);
+            }
+            check(whole && k == 2000, "the tree keeps its keys after a throw");
+            t.insertBatch(items.begin(), items.end());
+            check(t.verify() && distance(t.begin(), t.end()) == 2000 && t.find(1999)->second.v == -1999,
+                  "insertBatch after a throw");
+        }
+        check(Fragile::live == 0, "no values leak");
+    }
+    cout << "throwing copies in insertBatch" << endl;
+}
+
+typedef AVLTree<int, int> Tree;
+typedef AVLTree<int, int, NodePool, OrderStatistics> CountingTree;
+
+// fills t and m with count random keys from [0, range)
+template<typename T>
+static void fill(mt19937& rng, T& t, map<int, int>& m, int count, int range)
+{
+    for (int i = 0; i < count; i++) {
+        int key = (int)(rng() % range);
+        t.insert(make_pair(key, (int)rng()));
+        m[key] = t.find(key)->second;
+    }
+}
+
+// the keys of m less than key, and the rest
+static void splitMap(const map<int, int>& m, int key, map<int, int>& left, map<int, int>& right)
+{
+    left = map<int, int>(m.begin(), m.lower_bound(key));
+    right = map<int, int>(m.lower_bound(key), m.end());
+}
+
+static void testSplitJoin(int rounds)
+{
+    mt19937 rng(6);
+    for (int round = 0; round < rounds; round++) {
+        Tree t, left, right;
+        map<int, int> m, ml, mr;
+        int range = 1 + (int)(rng() % 5000);
+        fill(rng, t, m, (int)(rng() % 3000), range);
+        fill(rng, left, ml, 10, range);   // split replaces these
+        fill(rng, right, mr, 10, range);
+
+        // split keys inside the tree, on a key it holds, and past either end
+        int key = (int)(rng() % (range + 20)) - 10;
+        if (round % 4 == 0 && !m.empty()) key = m.begin()->first;
+        if (round % 4 == 1 && !m.empty()) key = m.rbegin()->first;
+        splitMap(m, key, ml, mr);
+        t.split(key, left, right);
+        check(t.empty() && t.height() == 0 && t.verify(), "split leaves the source empty");
+        check(same(left, ml) && left.verify(), "split left");
+        check(same(right, mr) && right.verify(), "split right");
+        check(m.count(key) == 0 || right.find(key) != right.end(), "split puts the key in right");
+
+        // join them back, into a third tree or into either side
+        Tree* target = (round % 3 == 0) ? &t : (round % 3 == 1) ? &left : &right;
+        target->join(left, right);
+        check(same(*target, m) && target->verify(), "join");
+        check((target == &left || left.empty()) && (target == &right || right.empty()), "join empties its arguments");
+
+        // split into itself, on either side
+        Tree other;
+        splitMap(m, key, ml, mr);
+        if (round % 2) {
+            target->split(key, *target, other);
+            check(same(*target, ml) && same(other, mr), "split with left aliasing the source");
+            check(target->verify() && other.verify(), "verify after aliased split");
+            target->join(*target, other);
+        }
+        else {
+            target->split(key, other, *target);
+            check(same(other, ml) && same(*target, mr), "split with right aliasing the source");
+            check(other.verify() && target->verify(), "verify after aliased split");
+            target->join(other, *target);
+        }
+        check(same(*target, m) && target->verify(), "join after an aliased split");
+
+        // the tree works normally after all the relinking
+        int extra = range + 1 + (int)(rng() % 100);
+        target->insert(make_pair(extra, extra));
+        m[extra] = extra;
+        if (!m.empty()) {
+            target->remove(m.begin()->first);
+            m.erase(m.begin());
+        }
+        check(same(*target, m) && target->verify(), "insert and remove after split and join");
+    }
+
+    // joining overlapping trees throws before changing either
+    Tree a, b, joined;
+    map<int, int> ma, mb;
+    a.insert(make_pair(1, 1));
+    a.insert(make_pair(5, 5));
+    b.insert(make_pair(5, 50));
+    b.insert(make_pair(9, 9));
+    ma[1] = 1; ma[5] = 5;
+    mb[5] = 50; mb[9] = 9;
+    bool threw = false;
+    try {
+        joined.join(a, b);
+    }
+    catch (const invalid_argument&) {
+        threw = true;
+    }
+    check(threw && same(a, ma) && same(b, mb), "join rejects overlapping keys");
+    threw = false;
+    try {
+        a.split(3, b, b);
+    }
+    catch (const invalid_argument&) {
+        threw = true;
+    }
+    check(threw && same(a, ma) && same(b, mb), "split rejects left and right being the same tree");
+    cout << rounds << " rounds of split and join" << endl;
+}
+
+// random removes and inserts of keys in [low, high) on a tree and its map,
+// for a thread of its own
+static void churn(Tree* t, map<int, int>* m, unsigned seed, int low, int high)
+{
+    mt19937 rng(seed);
+    for (int i = 0; i < 20000; i++) {
+        int key = low + (int)(rng() % (high - low));
+        if (rng() % 2) {
+            t->remove(key);
+            m->erase(key);
+        }
+        else {
+            t->insert(make_pair(key, i));
+            (*m)[key] = t->find(key)->second;
+        }
+    }
+}
+
+// The halves of a split hold nodes from the same slabs, so they must not
+// share any allocator state: each goes to its own thread, which removes and
+// inserts nodes in it. Meant to be run under -fsanitize=thread as well.
+static void testSplitThreads()
+{
+    mt19937 rng(8);
+    for (int round = 0; round < 4; round++) {
+        Tree t, other, right;
+        map<int, int> m, ml, mr;
+        fill(rng, t, m, 20000, 40000);
+        splitMap(m, 20000, ml, mr);
+        // odd rounds keep the left half in the source tree
+        Tree& left = (round % 2) ? t : other;
+        t.split(20000, left, right);
+        thread worker(churn, &right, &mr, round, 20000, 40000);
+        churn(&left, &ml, round + 100, 0, 20000);
+        worker.join();
+        check(same(left, ml) && left.verify(), "left half after use on its own thread");
+        check(same(right, mr) && right.verify(), "right half after use on its own thread");
+
+        // back together, then the joined tree and an emptied one apart
+        Tree& joined = (round % 2) ? other : t;
+        m = ml;
+        m.insert(mr.begin(), mr.end());
+        joined.join(left, right);
+        check(same(joined, m) && joined.verify(), "join after threaded use");
+        ml.clear();
+        worker = thread(churn, &left, &ml, round + 200, 0, 1000);
+        churn(&joined, &m, round + 300, 0, 40000);
+        worker.join();
+        check(same(joined, m) && same(left, ml), "joined tree and an emptied one on separate threads");
+    }
+    cout << "split halves on separate threads" << endl;
+}
+
+// After a set operation the result holds nodes from other's slabs, and other
+// is empty but still usable: the two go to separate threads.
+static void testSetOpsThreads()
+{
+    mt19937 rng(9);
+    for (int round = 0; round < 6; round++) {
+        Tree t, other;
+        map<int, int> m, mo;
+        fill(rng, t, m, 20000, 40000);
+        fill(rng, other, mo, 20000, 40000);
+        if (round % 3 == 0) {
+            t.unionWith(other);
+            for (map<int, int>::iterator it = mo.begin(); it != mo.end(); ++it) m[it->first] = it->second;
+        }
+        else if (round % 3 == 1) {
+            t.intersectWith(other);
+            map<int, int> both;
+            for (map<int, int>::iterator it = m.begin(); it != m.end(); ++it) {
+                if (mo.count(it->first)) both.insert(*it);
+            }
+            m = both;
+        }
+        else {
+            t.differenceWith(other);
+            for (map<int, int>::iterator it = mo.begin(); it != mo.end(); ++it) m.erase(it->first);
+        }
+        mo.clear();
+        check(same(t, m) && other.empty(), "set operation before threaded use");
+        thread worker(churn, &other, &mo, round, 0, 40000);
+        churn(&t, &m, round + 100, 0, 40000);
+        worker.join();
+        check(same(t, m) && t.verify(), "result after use on its own thread");
+        check(same(other, mo) && other.verify(), "other after use on its own thread");
+    }
+    cout << "set operation results and their arguments on separate threads" << endl;
+}
+
+// One round of each set operation on random trees whose sizes and key
+// ranges vary, so that some pairs overlap heavily and some barely.
+static void testSetOps(int rounds, const char* label)
+{
+    mt19937 rng(7);
+    for (int round = 0; round < rounds; round++) {
+        int op = round % 3;
+        int range = 100 + (int)(rng() % 50000);
+        int na = (int)(rng() % 20000), nb = (int)(rng() % 20000);
+        if (round % 5 == 0) nb = (int)(rng() % 10);    // lopsided sizes
+        Tree a, b;
+        map<int, int> ma, mb;
+        fill(rng, a, ma, na, range);
+        fill(rng, b, mb, nb, range);
+
+        map<int, int> expect;
+        if (op == 0) {
+            // other's value stays on keys in both
+            expect = mb;
+            expect.insert(ma.begin(), ma.end());
+            a.unionWith(b);
+        }
+        else if (op == 1) {
+            // this tree's value stays
+            for (map<int, int>::iterator it = ma.begin(); it != ma.end(); ++it) {
+                if (mb.count(it->first)) expect.insert(*it);
+            }
+            a.intersectWith(b);
+        }
+        else {
+            for (map<int, int>::iterator it = ma.begin(); it != ma.end(); ++it) {
+                if (!mb.count(it->first)) expect.insert(*it);
+            }
+            a.differenceWith(b);
+        }
+        const char* names[] = { "unionWith", "intersectWith", "differenceWith" };
+        if (!same(a, expect) || !a.verify()) {
+            cout << names[op] << ", " << na << " and " << nb << " keys from " << range << endl;
+            check(false, "set operation result");
+        }
+        check(b.empty() && b.begin() == b.end() && b.verify(), "set operation empties other");
+
+        // both trees keep working, and other can be refilled
+        b.insert(make_pair(1, 1));
+        a.insert(make_pair(range + 1, 0));
+        expect[range + 1] = 0;
+        check(same(a, expect) && a.verify() && b.verify(), "insert after a set operation");
+    }
+
+    // a tree combined with itself
+    Tree t;
+    map<int, int> m;
+    fill(rng, t, m, 1000, 5000);
+    t.unionWith(t);
+    check(same(t, m) && t.verify(), "unionWith itself");
+    t.intersectWith(t);
+    check(same(t, m) && t.verify(), "intersectWith itself");
+    t.differenceWith(t);
+    check(t.empty() && t.height() == 0 && t.verify(), "differenceWith itself");
+
+    // and with an empty tree, on either side
+    Tree empty;
+    m.clear();
+    fill(rng, t, m, 1000, 5000);
+    t.unionWith(empty);
+    check(same(t, m), "unionWith an empty tree");
+    empty.unionWith(t);
+    check(same(empty, m) && t.empty() && empty.verify(), "union into an empty tree");
+    empty.differenceWith(t);
+    check(same(empty, m), "differenceWith an empty tree");
+    empty.intersectWith(t);
+    check(empty.empty() && empty.verify(), "intersectWith an empty tree");
+    cout << rounds << " rounds of set operations, " << label << endl;
+}
+
+// Compares every order statistic of t with the sorted keys of m, at each key
+// and between and around them.
+static bool statisticsMatch(const CountingTree& t, const map<int, int>& m, mt19937& rng)
+{
+    vector<int> keys;
+    for (map<int, int>::const_iterator it = m.begin(); it != m.end(); ++it) keys.push_back(it->first);
+    if (t.size() != keys.size()) return false;
+    if (t.select(keys.size()) != t.end() || t.select(keys.size() + 5) != t.end()) return false;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (t.select(i) == t.end() || t.select(i)->first != keys[i]) return false;
+        if (t.rank(keys[i]) != i || t.rank(keys[i] + 1) != i + 1) return false;
+    }
+    int lowest = keys.empty() ? 0 : keys.front() - 2, highest = keys.empty() ? 0 : keys.back() + 2;
+    for (int probe = 0; probe < 200; probe++) {
+        int lo = lowest + (int)(rng() % (highest - lowest + 1));
+        int hi = lowest + (int)(rng() % (highest - lowest + 1));
+        size_t below = lower_bound(keys.begin(), keys.end(), lo) - keys.begin();
+        if (t.rank(lo) != below) return false;
+        size_t expect = (hi < lo) ? 0 : upper_bound(keys.begin(), keys.end(), hi) - keys.begin() - below;
+        if (t.countRange(lo, hi) != expect) return false;
+    }
+    return true;
+}
+
+// size, rank, select and countRange after every kind of update
+static void testOrderStatistics(int rounds)
+{
+    mt19937 rng(8);
+    CountingTree t;
+    map<int, int> m;
+    check(statisticsMatch(t, m, rng), "order statistics of an empty tree");
+    int range = 20000;
+    for (int round = 0; round < rounds; round++) {
+        int op = round % 6;
+        if (op == 0) {
+            fill(rng, t, m, 500, range);
+        }
+        else if (op == 1) {
+            for (int i = 0; i < 300; i++) {
+                int key = (int)(rng() % range);
+                t.remove(key);
+                m.erase(key);
+            }
+        }
+        else if (op == 2) {
+            vector<int> keys = sortedSample(rng, 1 + rng() % 2000, range);
+            vector< pair<int, int> > items;
+            for (size_t i = 0; i < keys.size(); i++) {
+                items.push_back(make_pair(keys[i], (int)i));
+                m[keys[i]] = (int)i;
+            }
+            t.insertBatch(items.begin(), items.end());
+        }
+        else if (op == 3) {
+            vector<int> keys = sortedSample(rng, 1 + rng() % 2000, range);
+            for (size_t i = 0; i < keys.size(); i++) m.erase(keys[i]);
+            t.removeBatch(keys.begin(), keys.end());
+        }
+        else if (op == 4) {
+            CountingTree left, right;
+            int key = (int)(rng() % range);
+            t.split(key, left, right);
+            map<int, int> ml, mr;
+            splitMap(m, key, ml, mr);
+            check(statisticsMatch(left, ml, rng) && statisticsMatch(right, mr, rng), "order statistics after split");
+            t.join(left, right);
+        }
+        else {
+            CountingTree other;
+            map<int, int> mo;
+            fill(rng, other, mo, 1000, range);
+            for (map<int, int>::iterator it = mo.begin(); it != mo.end(); ++it) m[it->first] = it->second;
+            t.unionWith(other);
+        }
+        check(same(t, m) && t.verify(), "contents after a mixed update");
+        check(statisticsMatch(t, m, rng), "order statistics after a mixed update");
+    }
+    cout << rounds << " rounds of order statistics, " << m.size() << " keys" << endl;
+}
+
+typedef AVLTree<int, long, NodePool, ValueSum<long> > SumTree;
+
+// a tree whose augment reads the values only lets them change through the
+// tree, so the stored augments cannot go stale
+static_assert(std::is_same<decltype(std::declval<SumTree&>()[0]), const long&>::value,
+              "operator[] of a ValueSum tree is read-only");
+static_assert(std::is_same<decltype(*std::declval<SumTree&>().begin()), const pair<const int, long>&>::value,
+              "iterators of a ValueSum tree are read-only");
+static_assert(std::is_same<decltype(std::declval<CountingTree&>()[0]), int&>::value,
+              "operator[] of a counting tree is writable");
+
+struct SumOf
+{
+    static long lift(long v) { return v; }
+    static long identity() { return 0; }
+    static long combine(long a, long b) { return a + b; }
+};
+
+struct MinOf
+{
+    static long lift(long v) { return v; }
+    static long identity() { return numeric_limits<long>::max(); }
+    static long combine(long a, long b) { return std::min(a, b); }
+};
+
+struct MaxOf
+{
+    static long lift(long v) { return v; }
+    static long identity() { return numeric_limits<long>::lowest(); }
+    static long combine(long a, long b) { return std::max(a, b); }
+};
+
+// Compares rangeQuery with a fold over the same keys of m, for random
+// ranges, ranges past the ends and empty ones.
+template<typename T, typename Fold>
+static bool queriesMatch(const T& t, const map<int, long>& m, mt19937& rng, int range)
+{
+    for (int probe = 0; probe < 100; probe++) {
+        int lo = (int)(rng() % (range + 20)) - 10, hi = (int)(rng() % (range + 20)) - 10;
+        if (probe == 0) {
+            lo = -10;
+            hi = range + 10;
+        }
+        long expect = Fold::identity();
+        for (map<int, long>::const_iterator it = m.lower_bound(lo); it != m.end() && it->first <= hi; ++it) {
+            expect = Fold::combine(expect, Fold::lift(it->second));
+        }
+        if (t.rangeQuery(lo, hi) != expect) return false;
+    }
+    return true;
+}
+
+// rangeQuery after every way the tree has of changing a value or a shape
+template<typename Augment, typename Fold>
+static void testRangeQuery(int rounds, const char* name)
+{
+    typedef AVLTree<int, long, NodePool, Augment> T;
+    mt19937 rng(9);
+    T t;
+    map<int, long> m;
+    int range = 5000;
+    check(queriesMatch<T, Fold>(t, m, rng, range), "rangeQuery of an empty tree");
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < 200; i++) {
+            int key = (int)(rng() % range);
+            long value = (long)(rng() % 2001) - 1000;
+            switch (rng() % 6) {
+            case 0:
+                t.insert(make_pair(key, value));
+                m[key] = value;
+                break;
+            case 1:
+                t.insert_or_assign(key, value);
+                m[key] = value;
+                break;
+            case 2:
+                t.insert(t.lower_bound(key), make_pair(key, value));
+                m[key] = value;
+                break;
+            case 3:
+                t.emplace(key, value);
+                m.insert(make_pair(key, value));
+                break;
+            case 4:
+                t.remove(key);
+                m.erase(key);
+                break;
+            default:
+                if (t.find(key) != t.end()) {
+                    t.erase(t.find(key));
+                    m.erase(key);
+                }
+            }
+        }
+        if (round % 3 == 0) {
+            vector<int> keys = sortedSample(rng, 1 + rng() % 1000, range);
+            vector< pair<int, long> > items;
+            for (size_t i = 0; i < keys.size(); i++) {
+                items.push_back(make_pair(keys[i], (long)i));
+                m[keys[i]] = (long)i;
+            }
+            t.insertBatch(items.begin(), items.end());
+        }
+        else if (round % 3 == 1) {
+            vector<int> keys = sortedSample(rng, 1 + rng() % 1000, range);
+            for (size_t i = 0; i < keys.size(); i++) m.erase(keys[i]);
+            t.removeBatch(keys.begin(), keys.end());
+        }
+        else {
+            T left, right;
+            t.split((int)(rng() % range), left, right);
+            t.join(left, right);
+        }
+        check(t.verify(), "verify with an augment");
+        check(queriesMatch<T, Fold>(t, m, rng, range), "rangeQuery after mixed updates");
+    }
+    cout << rounds << " rounds of rangeQuery, " << name << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 60;
+
+    testBuild();
+    testBatch(rounds);
+    testBatchThrows();
+    testSplitJoin(rounds * 10);
+    testSplitThreads();
+    testSetOps(rounds, "default threads");
+    // force the threaded recursion, even on one core
+    Tree::setParallelDepth(3);
+    testSetOps(rounds, "3 levels of threads");
+    Tree::setParallelDepth(-1);
+    testSetOpsThreads();
+    testOrderStatistics(rounds);
+    testRangeQuery<ValueSum<long>, SumOf>(rounds, "ValueSum");
+    testRangeQuery<ValueMin<long>, MinOf>(rounds, "ValueMin");
+    testRangeQuery<ValueMax<long>, MaxOf>(rounds, "ValueMax");
+
+    // the repro: an overwrite has to reach the sums above it
+    SumTree sums;
+    for (int k = 0; k < 100; k++) sums.insert(make_pair(k, 1L));
+    sums.insert_or_assign(50, 1000L);
+    check(sums.rangeQuery(0, 99) == 1099 && sums[50] == 1000, "insert_or_assign updates the sums");
+
+    cout << "Failures: " << failures << endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,590 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <random>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <new>
+#include <cstdlib>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+// Checks the map-style interface of BinarySearchTree and AVLTree against
+// std::map: the bound lookups and ranges, every iterator type, in both
+// directions and off either end, the moving inserts, with keys and values
+// that count their copies, the lookups by const char* in a std::less<>
+// string tree, which must not allocate, the hinted inserts, the finger
+// searches and erase, and the number of comparisons a lookup, insert or
+// remove makes, which must be one per level plus one.
+// Run with: ./bst-api-test [rounds]
+//
+// Each check runs on both trees, since AVLTree relinks nodes on its own
+// paths (rotations, its removeNode) that the cached ends and the parent
+// pointers the iterators climb have to survive.
+
+static int failures = 0;
+static long allocations = 0;
+
+// counts every allocation, to catch a lookup building a temporary Key
+void* operator new(size_t size)
+{
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (p == NULL) throw bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+typedef BinarySearchTree<int, int> Bst;
+typedef AVLTree<int, int> Avl;
+
+// a string that counts its copies; moves are free
+struct Counted
+{
+    static long copies;
+    string s;
+
+    Counted() {}
+    Counted(const char* str) : s(str) {}
+    Counted(const Counted& other) : s(other.s) { copies++; }
+    Counted(Counted&& other) : s(std::move(other.s)) {}
+    Counted& operator=(const Counted& other) { s = other.s; copies++; return *this; }
+    Counted& operator=(Counted&& other) { s = std::move(other.s); return *this; }
+    bool operator<(const Counted& other) const { return s < other.s; }
+    bool operator==(const Counted& other) const { return s == other.s; }
+};
+
+long Counted::copies = 0;
+
+// the trees' print() needs this to instantiate
+static ostream& operator<<(ostream& os, const Counted& c)
+{
+    return os << c.s;
+}
+
+// true if it points at the same pair as e, or both are at the end
+template<typename It>
+static bool at(const It& it, const It& end, const map<int, int>& m, map<int, int>::const_iterator e)
+{
+    if (e == m.end()) return it == end;
+    return it != end && it->first == e->first && it->second == e->second;
+}
+
+// fills t and m with count random keys from [0, range), in random order
+template<typename Tree>
+static void fill(mt19937& rng, Tree& t, map<int, int>& m, int count, int range)
+{
+    for (int i = 0; i < count; i++) {
+        int key = (int)(rng() % range);
+        t.insert(make_pair(key, i));
+        m[key] = i;
+    }
+}
+
+// lower_bound, upper_bound, equal_range and range at every key, between
+// keys, past both ends, and with lo > hi
+template<typename Tree>
+static void testBounds(int rounds, const char* name)
+{
+    mt19937 rng(10);
+    for (int round = 0; round < rounds; round++) {
+        Tree t;
+        map<int, int> m;
+        int range = 1 + (int)(rng() % 200);
+        fill(rng, t, m, (round == 0) ? 0 : (int)(rng() % 150), range);
+        for (int key = -3; key < range + 3; key++) {
+            check(at(t.lower_bound(key), t.end(), m, m.lower_bound(key)), "lower_bound");
+            check(at(t.upper_bound(key), t.end(), m, m.upper_bound(key)), "upper_bound");
+            check(at(t.find(key), t.end(), m, m.find(key)), "find");
+            pair<typename Tree::iterator, typename Tree::iterator> r = t.equal_range(key);
+            check(at(r.first, t.end(), m, m.lower_bound(key)) && at(r.second, t.end(), m, m.upper_bound(key)),
+                  "equal_range");
+            check((r.first == r.second) == (m.count(key) == 0), "equal_range is empty exactly for absent keys");
+        }
+        for (int probe = 0; probe < 50; probe++) {
+            int lo = (int)(rng() % (range + 6)) - 3, hi = (int)(rng() % (range + 6)) - 3;
+            vector< pair<int, int> > got, expect;
+            typename Tree::Range r = t.range(lo, hi);
+            for (typename Tree::iterator it = r.begin(); it != r.end(); ++it) got.push_back(*it);
+            if (lo <= hi) {
+                expect.assign(m.lower_bound(lo), m.upper_bound(hi));
+            }
+            check(got == expect, "range");
+            check(r.empty() == expect.empty(), "range empty()");
+        }
+    }
+    cout << rounds << " rounds of bounds, " << name << endl;
+}
+
+// forward and backward walks with every iterator type, and stepping back
+// from end()
+template<typename Tree>
+static void testIterators(int rounds, const char* name)
+{
+    mt19937 rng(11);
+    for (int round = 0; round < rounds; round++) {
+        Tree t;
+        map<int, int> m;
+        fill(rng, t, m, (round < 2) ? round : (int)(rng() % 300), 1000);
+        if (round % 2 && !m.empty()) {
+            // removes reshape the tree, and take out the ends first
+            t.remove(m.begin()->first);
+            m.erase(m.begin());
+            if (!m.empty()) {
+                t.remove(m.rbegin()->first);
+                m.erase(--m.end());
+            }
+        }
+        vector< pair<int, int> > expect(m.begin(), m.end()), got;
+
+        for (typename Tree::iterator it = t.begin(); it != t.end(); it++) got.push_back(*it);
+        check(got == expect, "iterator forward");
+        got.clear();
+        for (typename Tree::const_iterator it = t.cbegin(); it != t.cend(); ++it) got.push_back(*it);
+        check(got == expect, "const_iterator forward");
+        got.clear();
+        for (typename Tree::path_iterator it = t.pathBegin(); it != t.pathEnd(); it++) got.push_back(*it);
+        check(got == expect, "path_iterator forward");
+        got.clear();
+
+        // backward, by decrementing from end() and with the reverse iterators
+        vector< pair<int, int> > reversed(expect.rbegin(), expect.rend());
+        if (!t.empty()) {
+            typename Tree::iterator it = t.end();
+            do {
+                --it;
+                got.push_back(*it);
+            } while (it != t.begin());
+        }
+        check(got == reversed, "iterator backward from end()");
+        got.clear();
+        if (!t.empty()) {
+            typename Tree::const_iterator it = t.cend();
+            do {
+                it--;
+                got.push_back(*it);
+            } while (it != t.cbegin());
+        }
+        check(got == reversed, "const_iterator backward from end()");
+        got.clear();
+        for (typename Tree::reverse_iterator it = t.rbegin(); it != t.rend(); ++it) got.push_back(*it);
+        check(got == reversed, "reverse_iterator");
+        got.clear();
+        for (typename Tree::const_reverse_iterator it = t.crbegin(); it != t.crend(); ++it) got.push_back(*it);
+        check(got == reversed, "const_reverse_iterator");
+
+        // one step each way from a random pair, post and pre
+        if (!m.empty()) {
+            map<int, int>::const_iterator e = m.begin();
+            advance(e, rng() % m.size());
+            typename Tree::iterator it = t.find(e->first);
+            typename Tree::iterator before = it--;
+            check(at(before, t.end(), m, e), "post-decrement returns the old position");
+            check(e == m.begin() ? it == t.end() : at(it, t.end(), m, prev(e)), "decrement");
+            it = t.find(e->first);
+            typename Tree::iterator after = ++it;
+            check(at(after, t.end(), m, next(e)), "increment");
+            check(at(--t.end(), t.end(), m, prev(m.end())), "--end() is the largest pair");
+        }
+    }
+
+    // an empty tree: every walk is empty and end() stays where it is
+    Tree t;
+    check(t.begin() == t.end() && t.cbegin() == t.cend(), "empty begin() == end()");
+    check(t.rbegin() == t.rend() && t.pathBegin() == t.pathEnd(), "empty reverse and path walks");
+    check(--t.end() == t.end(), "--end() of an empty tree");
+    check(t.lower_bound(0) == t.end() && t.upper_bound(0) == t.end() && t.range(0, 10).empty(),
+          "bounds in an empty tree");
+
+    // iterators convert to const_iterators and compare equal
+    t.insert(make_pair(1, 1));
+    typename Tree::const_iterator c = t.find(1);
+    check(c == t.cbegin() && c->second == 1, "iterator to const_iterator");
+    cout << rounds << " rounds of iterators, " << name << endl;
+}
+
+// true if begin() and --end() are the smallest and largest pairs of m
+template<typename Tree>
+static bool endsMatch(const Tree& t, const map<int, int>& m)
+{
+    if (m.empty()) return t.begin() == t.end();
+    return at(t.begin(), t.end(), m, m.begin()) && at(--t.end(), t.end(), m, prev(m.end()));
+}
+
+// a random iterator into t, end() included
+template<typename Tree>
+static typename Tree::iterator randomPosition(mt19937& rng, const Tree& t, const map<int, int>& m)
+{
+    typename Tree::iterator it = t.begin();
+    for (size_t steps = rng() % (m.size() + 1); steps > 0; steps--) ++it;
+    return it;
+}
+
+// append_back and insert(hint, pair) with the right hint, a wrong one and
+// end(), interleaved with removing the smallest and largest keys, which the
+// appends and begin() rely on the tree keeping track of
+template<typename Tree>
+static void testHints(int rounds, bool balanced, const char* name)
+{
+    mt19937 rng(24);
+    for (int round = 0; round < rounds; round++) {
+        Tree t;
+        map<int, int> m;
+        int next = 0;
+        bool ends = true, returned = true;
+        for (int i = 0; i < 400; i++) {
+            int op = (int)(rng() % 6);
+            typename Tree::iterator r;
+            int key;
+            if (op == 0 || m.empty()) {
+                // mostly past the largest key, sometimes onto it
+                key = (rng() % 4 == 0 && !m.empty()) ? m.rbegin()->first : next++;
+                r = t.append_back(make_pair(key, i));
+            }
+            else if (op == 1) {
+                // the right hint: the pair after where the key goes
+                key = (int)(rng() % (next + 10)) - 5;
+                typename Tree::iterator hint = t.lower_bound(key);
+                r = t.insert(hint, make_pair(key, i));
+            }
+            else if (op == 2) {
+                key = (int)(rng() % (next + 10)) - 5;
+                r = t.insert(randomPosition(rng, t, m), make_pair(key, i));
+            }
+            else if (op == 3) {
+                key = (int)(rng() % (next + 10)) - 5;
+                r = t.insert(t.end(), make_pair(key, i));
+            }
+            else {
+                // take out an end, the smallest key or the largest
+                t.remove(op == 4 ? m.begin()->first : m.rbegin()->first);
+                m.erase(op == 4 ? m.begin() : prev(m.end()));
+                ends = ends && endsMatch(t, m);
+                continue;
+            }
+            m[key] = i;
+            returned = returned && r != t.end() && r->first == key && r->second == i;
+            ends = ends && endsMatch(t, m);
+        }
+        check(returned, "hinted inserts return the pair they inserted or overwrote");
+        check(ends, "begin() and --end() after hinted inserts and removing the ends");
+        vector< pair<int, int> > got(t.begin(), t.end());
+        check(got == vector< pair<int, int> >(m.begin(), m.end()), "contents after hinted inserts");
+        check(!balanced || t.isBalanced(), "balanced after hinted inserts");
+    }
+    cout << rounds << " rounds of hinted inserts, " << name << endl;
+}
+
+// find(hint, key) and remove(hint, key) from hints near the key, far from
+// it and at end(), and erase(pos), whose result must be the pair after pos
+template<typename Tree>
+static void testFingers(int rounds, bool balanced, const char* name)
+{
+    mt19937 rng(25);
+    for (int round = 0; round < rounds; round++) {
+        Tree t;
+        map<int, int> m;
+        int range = 1 + (int)(rng() % 600);
+        fill(rng, t, m, (int)(rng() % 400), range);
+        bool found = true, erased = true, ends = true;
+        for (int i = 0; i < 300; i++) {
+            int key = (int)(rng() % (range + 4)) - 2;
+            typename Tree::iterator hint;
+            switch (rng() % 3) {
+            case 0:
+                hint = t.lower_bound(key + (int)(rng() % 5) - 2);
+                break;
+            case 1:
+                hint = randomPosition(rng, t, m);
+                break;
+            default:
+                hint = t.end();
+                break;
+            }
+            found = found && at(t.find(hint, key), t.end(), m, m.find(key));
+
+            int op = (int)(rng() % 4);
+            if (op == 0) {
+                t.remove(hint, key);
+                m.erase(key);
+            }
+            else if (op == 1 && !m.empty()) {
+                // erase at a random pair, or at either end
+                map<int, int>::iterator e = m.begin();
+                int where = (int)(rng() % 3);
+                if (where == 0) advance(e, rng() % m.size());
+                if (where == 1) e = prev(m.end());
+                typename Tree::iterator r = t.erase(t.find(e->first));
+                e = m.erase(e);
+                erased = erased && at(r, t.end(), m, e);
+            }
+            else if (op == 2) {
+                t.insert(make_pair(key, i));
+                m[key] = i;
+            }
+            ends = ends && endsMatch(t, m);
+        }
+        check(found, "find(hint, key) matches find(key)");
+        check(erased, "erase returns the pair after the erased one");
+        check(ends, "begin() and --end() after finger removes and erases");
+
+        // erase(end()) does nothing, and erase can empty a range, or the tree
+        size_t size = m.size();
+        check(t.erase(t.end()) == t.end() && (size_t)distance(t.begin(), t.end()) == size, "erase(end())");
+        int lo = range / 3, hi = 2 * range / 3;
+        typename Tree::iterator it = t.lower_bound(lo);
+        while (it != t.end() && it->first < hi) it = t.erase(it);
+        m.erase(m.lower_bound(lo), m.lower_bound(hi));
+        check(at(it, t.end(), m, m.lower_bound(hi)), "erasing a range ends at its upper bound");
+        vector< pair<int, int> > got(t.begin(), t.end());
+        check(got == vector< pair<int, int> >(m.begin(), m.end()), "contents after finger removes and erases");
+        check(!balanced || t.isBalanced(), "balanced after finger removes and erases");
+        for (it = t.begin(); it != t.end(); it = t.erase(it)) {}
+        check(t.empty() && t.begin() == t.end(), "erasing every pair");
+    }
+    cout << rounds << " rounds of finger searches, " << name << endl;
+}
+
+// rvalue insert, emplace, try_emplace and insert_or_assign copy neither the
+// key nor the value, whether they add a pair or find the key already there
+template<typename Tree>
+static void testMoves(int rounds, const char* name)
+{
+    mt19937 rng(18);
+    for (int round = 0; round < rounds; round++) {
+        Tree t;
+        map<string, string> m;
+        long expected = Counted::copies;
+        for (int i = 0; i < 200; i++) {
+            string key = "key " + to_string(rng() % 100) + " long enough to allocate";
+            string value = "value " + to_string(i) + " long enough to allocate";
+            Counted k(key.c_str()), v(value.c_str());
+            bool fresh = m.count(key) == 0;
+            pair<typename Tree::iterator, bool> r;
+            switch (rng() % 4) {
+            case 0:
+                r = t.emplace(std::move(k), std::move(v));
+                check(r.second == fresh && r.first->first.s == key, "emplace");
+                if (fresh) m[key] = value;
+                break;
+            case 1:
+                r = t.try_emplace(std::move(k), value.c_str());
+                check(r.second == fresh && r.first->first.s == key, "try_emplace");
+                check(fresh || k.s == key, "try_emplace leaves the key alone if it is there");
+                if (fresh) m[key] = value;
+                break;
+            case 2:
+                r = t.insert_or_assign(std::move(k), std::move(v));
+                check(r.second == fresh && r.first->first.s == key && r.first->second.s == value,
+                      "insert_or_assign");
+                m[key] = value;
+                break;
+            default:
+                // the key is const in the pair, so a new pair copies it
+                if (fresh) expected++;
+                t.insert(make_pair(std::move(k), std::move(v)));
+                m[key] = value;
+                break;
+            }
+        }
+        check(Counted::copies == expected, "moving inserts make no copies");
+
+        vector< pair<string, string> > got;
+        for (typename Tree::iterator it = t.begin(); it != t.end(); ++it) {
+            got.push_back(make_pair(it->first.s, it->second.s));
+        }
+        check(got == vector< pair<string, string> >(m.begin(), m.end()), "contents after moving inserts");
+    }
+
+    // the copying overloads still copy, once each
+    Tree t;
+    Counted k("k"), v("v");
+    long copies = Counted::copies;
+    t.try_emplace(k, "v");
+    check(Counted::copies == copies + 1 && k.s == "k", "try_emplace(const Key&) copies only the key");
+    t.insert_or_assign(k, v);
+    check(Counted::copies == copies + 2 && v.s == "v", "insert_or_assign of an lvalue copies the value");
+    cout << rounds << " rounds of moving inserts, " << name << endl;
+}
+
+// with std::less<>, find, the bounds, operator[] and remove take a const
+// char* as is; with std::less<string> each one builds a string
+template<typename Tree, typename PlainTree>
+static void testTransparent(bool balanced, const char* name)
+{
+    Tree t;
+    map<string, int> m;
+    vector<string> probes;
+    for (int k = 0; k < 600; k++) {
+        string key = "key " + to_string(k * 7 % 600) + " long enough to allocate";
+        if (k % 3) {
+            t.insert(make_pair(key, k));
+            m[key] = k;
+        }
+        probes.push_back(key);
+    }
+    probes.push_back("");
+    probes.push_back("zzz past the largest key in the tree");
+
+    // the expected answers, worked out before counting starts
+    vector<const string*> found, lower, upper;
+    vector<int> values;
+    for (size_t i = 0; i < probes.size(); i++) {
+        map<string, int>::iterator e = m.find(probes[i]);
+        found.push_back(e == m.end() ? NULL : &e->first);
+        values.push_back(e == m.end() ? 0 : e->second);
+        e = m.lower_bound(probes[i]);
+        lower.push_back(e == m.end() ? NULL : &e->first);
+        e = m.upper_bound(probes[i]);
+        upper.push_back(e == m.end() ? NULL : &e->first);
+    }
+
+    const Tree& ct = t;
+    long before = allocations;
+    bool same = true;
+    for (size_t i = 0; i < probes.size(); i++) {
+        const char* key = probes[i].c_str();
+        typename Tree::iterator it = t.find(key);
+        same = same && (found[i] ? it != t.end() && it->first == *found[i] : it == t.end());
+        it = t.lower_bound(key);
+        same = same && (lower[i] ? it != t.end() && it->first == *lower[i] : it == t.end());
+        it = t.upper_bound(key);
+        same = same && (upper[i] ? it != t.end() && it->first == *upper[i] : it == t.end());
+        if (found[i]) {
+            same = same && t[key] == values[i] && ct[key] == values[i];
+        }
+    }
+    for (size_t i = 0; i < probes.size(); i += 2) {
+        t.remove(probes[i].c_str());
+    }
+    check(allocations == before, "lookups and removes by const char* do not allocate");
+    check(same, "lookups by const char*");
+
+    for (size_t i = 0; i < probes.size(); i += 2) m.erase(probes[i]);
+    vector< pair<string, int> > got;
+    for (typename Tree::iterator it = t.begin(); it != t.end(); ++it) got.push_back(*it);
+    check(got == vector< pair<string, int> >(m.begin(), m.end()), "removes by const char*");
+    check(!balanced || t.isBalanced(), "balanced after removes by const char*");
+
+    // a missing key still throws
+    bool threw = false;
+    try {
+        t["not in the tree, and long enough to allocate"];
+    }
+    catch (const out_of_range&) {
+        threw = true;
+    }
+    check(threw, "operator[] of a missing const char* throws out_of_range");
+
+    // the counter does see the temporaries a std::less<string> tree needs
+    PlainTree plain;
+    plain.insert(make_pair(probes[1], 1));
+    before = allocations;
+    check(plain.find(probes[1].c_str()) != plain.end(), "find by const char* in a std::less<string> tree");
+    check(allocations > before, "a std::less<string> lookup by const char* builds a string");
+    cout << "transparent lookups, " << name << endl;
+}
+
+// a comparator that counts its calls; the trees make a fresh one for each
+struct CountingLess {
+    static long calls;
+    bool operator()(int a, int b) const
+    {
+        calls++;
+        return a < b;
+    }
+};
+long CountingLess::calls = 0;
+
+// exposes the height, in nodes, of either tree
+template<typename Tree>
+class Measured : public Tree
+{
+public:
+    int treeHeight() const { return heightOf(this->root_); }
+
+private:
+    static int heightOf(const Node<int, int>* n)
+    {
+        return n ? 1 + max(heightOf(n->getLeft()), heightOf(n->getRight())) : 0;
+    }
+};
+
+// the descent compares once per level, and only the node it stops at is
+// checked for equality, so h + 1 comparisons at most for a tree of height h
+template<typename Tree>
+static void testComparisons(int rounds, const char* name)
+{
+    mt19937 rng(20);
+    Measured<Tree> t;
+    map<int, int> m;
+    bool finds = true, inserts = true, removes = true;
+    int range = 4000;
+    for (int i = 0; i < rounds * 20; i++) {
+        int key = (int)(rng() % range);
+        long bound = t.treeHeight() + 1;
+        CountingLess::calls = 0;
+        bool present = t.find(key) != t.end();
+        finds = finds && CountingLess::calls <= bound && present == (m.count(key) == 1);
+
+        CountingLess::calls = 0;
+        if (i < rounds * 10 || rng() % 2) {
+            t.insert(make_pair(key, i));
+            m[key] = i;
+            inserts = inserts && CountingLess::calls <= bound;
+        }
+        else {
+            t.remove(key);
+            m.erase(key);
+            removes = removes && CountingLess::calls <= bound;
+        }
+    }
+    check(finds, "find makes at most height + 1 comparisons");
+    check(inserts, "insert makes at most height + 1 comparisons");
+    check(removes, "remove makes at most height + 1 comparisons");
+    check(equal(t.begin(), t.end(), m.begin(), m.end()), "contents with a counting comparator");
+    cout << rounds << " rounds of counted comparisons, " << name << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 200;
+
+    testBounds<Bst>(rounds, "BinarySearchTree");
+    testBounds<Avl>(rounds, "AVLTree");
+    testIterators<Bst>(rounds, "BinarySearchTree");
+    testIterators<Avl>(rounds, "AVLTree");
+    testMoves< BinarySearchTree<Counted, Counted> >(rounds, "BinarySearchTree");
+    testMoves< AVLTree<Counted, Counted> >(rounds, "AVLTree");
+    testTransparent< BinarySearchTree<string, int, NodePool, less<> >, BinarySearchTree<string, int> >(false, "BinarySearchTree");
+    testTransparent< AVLTree<string, int, NodePool, NoAugment, less<> >, AVLTree<string, int> >(true, "AVLTree");
+    testHints<Bst>(rounds, false, "BinarySearchTree");
+    testHints<Avl>(rounds, true, "AVLTree");
+    testFingers<Bst>(rounds, false, "BinarySearchTree");
+    testFingers<Avl>(rounds, true, "AVLTree");
+    testComparisons< BinarySearchTree<int, int, NodePool, CountingLess> >(rounds, "BinarySearchTree");
+    testComparisons< AVLTree<int, int, NodePool, NoAugment, CountingLess> >(rounds, "AVLTree");
+
+    cout << "Failures: " << failures << endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,520 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <climits>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "bst.h"
+#include "avlbst.h"
+#include "compact-avl.h"
+#include "concurrent-avl.h"
+#include "persistent-avl.h"
+#include "sharded-map.h"
+#include "simd-index.h"
+#include "btree-map.h"
+
+using namespace std;
+
+// Build with: make bench
+// Run with:   ./bst-bench [number of keys]
+
+typedef chrono::steady_clock Clock;
+
+// keeps the optimizer from throwing away lookups whose result is unused
+static volatile long sink;
+
+static double nsPer(Clock::time_point start, Clock::time_point stop, size_t ops)
+{
+    return chrono::duration<double, nano>(stop - start).count() / ops;
+}
+
+static void report(const string& name, double ns)
+{
+    cout << left << setw(40) << name << right << setw(10) << fixed << setprecision(1) << ns << " ns/op" << endl;
+}
+
+template<typename Tree>
+void benchLookup(const string& name, const vector<int>& keys, const vector<int>& probes)
+{
+    Tree tree;
+    for (size_t i = 0; i < keys.size(); i++) {
+        tree.insert(std::make_pair(keys[i], (int)i));
+    }
+
+    long found = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < probes.size(); i++) {
+        if (tree.find(probes[i]) != tree.end()) found++;
+    }
+    Clock::time_point stop = Clock::now();
+    sink = found;
+    report(name + " find", nsPer(start, stop, probes.size()));
+}
+
+// increasing keys, as timestamps or sequence numbers arrive: a plain insert
+// searches from the root every time, append_back links at the largest node
+void benchAppend(size_t n)
+{
+    AVLTree<int, int> inserted, appended;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; i++) {
+        inserted.insert(std::make_pair((int)i, (int)i));
+    }
+    Clock::time_point mid = Clock::now();
+    for (size_t i = 0; i < n; i++) {
+        appended.append_back(std::make_pair((int)i, (int)i));
+    }
+    Clock::time_point stop = Clock::now();
+    report("AVLTree<int,int> increasing insert", nsPer(start, mid, n));
+    report("AVLTree<int,int> append_back", nsPer(mid, stop, n));
+}
+
+// lookups that each land a few keys after the last one: from the root,
+// then as finger searches from the previous hit
+void benchFinger(const vector<int>& keys)
+{
+    AVLTree<int, int> tree;
+    for (size_t i = 0; i < keys.size(); i++) {
+        tree.insert(std::make_pair(keys[i], (int)i));
+    }
+    mt19937 rng(777);
+    vector<int> walk(keys.size());
+    int at = 0;
+    for (size_t i = 0; i < walk.size(); i++) {
+        at = (at + (int)(rng() % 8)) % (int)(2 * keys.size());
+        walk[i] = at;
+    }
+
+    long found = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < walk.size(); i++) {
+        if (tree.find(walk[i]) != tree.end()) found++;
+    }
+    Clock::time_point mid = Clock::now();
+    AVLTree<int, int>::iterator hint = tree.begin();
+    for (size_t i = 0; i < walk.size(); i++) {
+        AVLTree<int, int>::iterator it = tree.find(hint, walk[i]);
+        if (it != tree.end()) {
+            found++;
+            hint = it;
+        }
+    }
+    Clock::time_point stop = Clock::now();
+    sink = found;
+    report("AVLTree<int,int> near-sorted find", nsPer(start, mid, walk.size()));
+    report("AVLTree<int,int> near-sorted finger find", nsPer(mid, stop, walk.size()));
+}
+
+// lookups in an AVLTree, then in the FrozenMap it freezes into, against a
+// binary search over the same sorted pairs
+void benchFrozen(const vector<int>& keys, const vector<int>& probes)
+{
+    AVLTree<int, int> tree;
+    for (size_t i = 0; i < keys.size(); i++) {
+        tree.insert(std::make_pair(keys[i], (int)i));
+    }
+    vector< pair<int, int> > sorted(tree.begin(), tree.end());
+
+    long found = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < probes.size(); i++) {
+        if (tree.find(probes[i]) != tree.end()) found++;
+    }
+    Clock::time_point mid = Clock::now();
+    FrozenMap<int, int> frozen = tree.freeze();
+    Clock::time_point mid2 = Clock::now();
+    for (size_t i = 0; i < probes.size(); i++) {
+        if (frozen.find(probes[i]) != frozen.end()) found++;
+    }
+    Clock::time_point mid3 = Clock::now();
+    for (size_t i = 0; i < probes.size(); i++) {
+        vector< pair<int, int> >::iterator it = lower_bound(sorted.begin(), sorted.end(), make_pair(probes[i], INT_MIN));
+        if (it != sorted.end() && it->first == probes[i]) found++;
+    }
+    Clock::time_point stop = Clock::now();
+    sink = found;
+    report("AVLTree<int,int> find", nsPer(start, mid, probes.size()));
+    report("AVLTree<int,int> freeze, per key", nsPer(mid, mid2, keys.size()));
+    report("FrozenMap<int,int> find", nsPer(mid2, mid3, probes.size()));
+    report("sorted array binary search", nsPer(mid3, stop, probes.size()));
+}
+
+// long keys sharing a long prefix, so every comparison scans most of both
+static string longKey(int i)
+{
+    return string(48, 'k') + to_string(i);
+}
+
+// std::less, counting its calls
+struct CountingLess
+{
+    static long calls;
+    bool operator()(const string& a, const string& b) const
+    {
+        calls++;
+        return a < b;
+    }
+};
+long CountingLess::calls = 0;
+
+// find and insert with long string keys, timed in Tree and then counted in
+// CountedTree, the same tree with CountingLess
+template<typename Tree, typename CountedTree>
+void benchStringKeys(const string& name, const vector<int>& keys, const vector<int>& probes)
+{
+    vector<string> keyStrings, probeStrings;
+    for (size_t i = 0; i < keys.size(); i++) keyStrings.push_back(longKey(keys[i]));
+    for (size_t i = 0; i < probes.size(); i++) probeStrings.push_back(longKey(probes[i]));
+
+    Tree tree;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < keyStrings.size(); i++) {
+        tree.insert(std::make_pair(keyStrings[i], (int)i));
+    }
+    Clock::time_point mid = Clock::now();
+    long found = 0;
+    for (size_t i = 0; i < probeStrings.size(); i++) {
+        if (tree.find(probeStrings[i]) != tree.end()) found++;
+    }
+    Clock::time_point stop = Clock::now();
+    sink = found;
+    report(name + "<string,int> insert", nsPer(start, mid, keyStrings.size()));
+    report(name + "<string,int> find", nsPer(mid, stop, probeStrings.size()));
+
+    CountedTree counted;
+    CountingLess::calls = 0;
+    for (size_t i = 0; i < keyStrings.size(); i++) {
+        counted.insert(std::make_pair(keyStrings[i], (int)i));
+    }
+    long insertCalls = CountingLess::calls;
+    CountingLess::calls = 0;
+    for (size_t i = 0; i < probeStrings.size(); i++) {
+        if (counted.find(probeStrings[i]) != counted.end()) found++;
+    }
+    sink = found;
+    cout << left << setw(40) << (name + "<string,int> compares/op") << right << setw(10) << fixed << setprecision(1)
+         << (double)insertCalls / keyStrings.size() << " insert, "
+         << (double)CountingLess::calls / probeStrings.size() << " find" << endl;
+}
+
+// lookups in an AVLTree (internalFind), then in a SimdIndex built from it,
+// for each key type with a vectorized node search
+template<typename Key>
+void benchSimdIndex(const string& name, const vector<int>& keys, const vector<int>& probes)
+{
+    AVLTree<Key, int> tree;
+    for (size_t i = 0; i < keys.size(); i++) {
+        tree.insert(std::make_pair((Key)keys[i], (int)i));
+    }
+    vector<Key> queries(probes.begin(), probes.end());
+
+    long found = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < queries.size(); i++) {
+        if (tree.find(queries[i]) != tree.end()) found++;
+    }
+    Clock::time_point mid = Clock::now();
+    SimdIndex<Key, int> index(tree.begin(), tree.end());
+    Clock::time_point mid2 = Clock::now();
+    for (size_t i = 0; i < queries.size(); i++) {
+        if (index.find(queries[i]) != index.end()) found++;
+    }
+    Clock::time_point stop = Clock::now();
+    sink = found;
+    string simd = SimdNodeSearch<Key>::vectorized ? "" : " (scalar)";
+    report("AVLTree<" + name + ",int> find", nsPer(start, mid, queries.size()));
+    report("SimdIndex<" + name + ",int> build, per key", nsPer(mid, mid2, keys.size()));
+    report("SimdIndex<" + name + ",int> find" + simd, nsPer(mid2, stop, queries.size()));
+}
+
+// full in-order scans with the parent-climbing iterator, backwards with a
+// reverse iterator, and with the path-stack iterator
+template<typename Tree>
+void benchScan(const string& name, const vector<int>& keys)
+{
+    Tree tree;
+    for (size_t i = 0; i < keys.size(); i++) {
+        tree.insert(std::make_pair(keys[i], (int)i));
+    }
+
+    long sum = 0;
+    Clock::time_point start = Clock::now();
+    for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        sum += it->second;
+    }
+    Clock::time_point mid = Clock::now();
+    for (typename Tree::reverse_iterator it = tree.rbegin(); it != tree.rend(); ++it) {
+        sum += it->second;
+    }
+    Clock::time_point mid2 = Clock::now();
+    for (typename Tree::path_iterator it = tree.pathBegin(); it != tree.pathEnd(); ++it) {
+        sum += it->second;
+    }
+    Clock::time_point stop = Clock::now();
+    sink = sum;
+    report(name + " scan, iterator", nsPer(start, mid, keys.size()));
+    report(name + " scan, reverse_iterator", nsPer(mid, mid2, keys.size()));
+    report(name + " scan, path_iterator", nsPer(mid2, stop, keys.size()));
+}
+
+// applies a sorted batch of updates (half overwrites, half new keys) one key
+// at a time and then through insertBatch
+void benchBatch(const vector<int>& keys, size_t batchSize)
+{
+    vector< pair<int, int> > batch;
+    size_t stride = keys.size() / batchSize;
+    for (size_t i = 0; i < batchSize; i++) {
+        batch.push_back(make_pair((int)(i * stride), -1));
+    }
+
+    AVLTree<int, int> loop, batched;
+    for (size_t i = 0; i < keys.size(); i++) {
+        loop.insert(make_pair(keys[i], (int)i));
+        batched.insert(make_pair(keys[i], (int)i));
+    }
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < batch.size(); i++) {
+        loop.insert(batch[i]);
+    }
+    Clock::time_point mid = Clock::now();
+    batched.insertBatch(batch.begin(), batch.end());
+    Clock::time_point stop = Clock::now();
+
+    string k = to_string(batchSize);
+    report("AVLTree insert x" + k + ", per key", nsPer(start, mid, batch.size()));
+    report("AVLTree insertBatch x" + k, nsPer(mid, stop, batch.size()));
+}
+
+// merges a tree holding every other key into one holding the rest, by
+// re-inserting each pair and then through unionWith
+void benchUnion(const vector<int>& keys)
+{
+    AVLTree<int, int> loopA, loopB, joinA, joinB;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (i % 2) {
+            loopA.insert(make_pair(keys[i], (int)i));
+            joinA.insert(make_pair(keys[i], (int)i));
+        }
+        else {
+            loopB.insert(make_pair(keys[i], (int)i));
+            joinB.insert(make_pair(keys[i], (int)i));
+        }
+    }
+
+    size_t moved = keys.size() / 2;
+    Clock::time_point start = Clock::now();
+    for (AVLTree<int, int>::iterator it = loopB.begin(); it != loopB.end(); ++it) {
+        loopA.insert(*it);
+    }
+    Clock::time_point mid = Clock::now();
+    joinA.unionWith(joinB);
+    Clock::time_point stop = Clock::now();
+
+    report("AVLTree merge by insert", nsPer(start, mid, moved));
+    report("AVLTree unionWith (" + to_string(thread::hardware_concurrency()) + " hw threads)", nsPer(mid, stop, moved));
+}
+
+// builds a PersistentAVLTree by insertion, without snapshots (updates in
+// place) and holding a snapshot of every version (a full path copy each time)
+void benchPersistent(const vector<int>& keys)
+{
+    PersistentAVLTree<int, int> plain, versioned;
+    PersistentAVLSnapshot<int, int> last;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < keys.size(); i++) {
+        plain.insert(make_pair(keys[i], (int)i));
+    }
+    Clock::time_point mid = Clock::now();
+    for (size_t i = 0; i < keys.size(); i++) {
+        versioned.insert(make_pair(keys[i], (int)i));
+        last = versioned.snapshot();
+    }
+    Clock::time_point stop = Clock::now();
+    report("PersistentAVLTree insert", nsPer(start, mid, keys.size()));
+    report("PersistentAVLTree insert + snapshot", nsPer(mid, stop, keys.size()));
+}
+
+// an AVLTree behind one global mutex, the baseline for ConcurrentAVLMap
+struct MutexAVLMap
+{
+    bool find(int key, int& value) const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        AVLTree<int, int>::iterator it = tree.find(key);
+        if (it == tree.end()) return false;
+        value = it->second;
+        return true;
+    }
+    void insert(const pair<const int, int>& item)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tree.insert(item);
+    }
+    void remove(int key)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tree.remove(key);
+    }
+
+    AVLTree<int, int> tree;
+    mutable std::mutex lock;
+};
+
+// aggregate lookup throughput of readers threads sharing one map while a
+// writer keeps inserting and removing keys, pausing WRITE_PAUSE_US between
+// updates; reported as wall time per lookup (and per update)
+static const int WRITE_PAUSE_US = 20;
+
+template<typename Map>
+void benchConcurrent(const string& name, const vector<int>& keys, int readers)
+{
+    Map shared;
+    for (size_t i = 0; i < keys.size(); i++) {
+        shared.insert(make_pair(keys[i], (int)i));
+    }
+
+    atomic<bool> done(false);
+    atomic<long> reads(0), writes(0);
+    vector<thread> threads;
+    threads.push_back(thread([&]() {
+        long n = 0;
+        for (unsigned i = 0; !done.load(memory_order_relaxed); i++) {
+            int key = (int)(i % keys.size()) * 2 + 1;
+            if (n % 2) shared.remove(key);
+            else shared.insert(make_pair(key, (int)i));
+            n++;
+            this_thread::sleep_for(chrono::microseconds(WRITE_PAUSE_US));
+        }
+        writes += n;
+    }));
+    for (int r = 0; r < readers; r++) {
+        threads.push_back(thread([&, r]() {
+            mt19937 rng(r);
+            long n = 0, found = 0;
+            int value;
+            while (!done.load(memory_order_relaxed)) {
+                if (shared.find(keys[rng() % keys.size()], value)) found++;
+                n++;
+            }
+            sink = found;
+            reads += n;
+        }));
+    }
+
+    Clock::time_point start = Clock::now();
+    this_thread::sleep_for(chrono::milliseconds(300));
+    done = true;
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    Clock::time_point stop = Clock::now();
+    report(name + " find, " + to_string(readers) + " readers + 1 writer", nsPer(start, stop, reads.load()));
+    report(name + " updates", nsPer(start, stop, writes.load()));
+}
+
+// aggregate update throughput of writers threads inserting and removing
+// disjoint keys in one shared map, reported as wall time per update
+template<typename Map>
+void benchWriters(const string& name, Map& shared, const vector<int>& keys, int writers)
+{
+    atomic<bool> done(false);
+    atomic<long> updates(0);
+    vector<thread> threads;
+    for (int w = 0; w < writers; w++) {
+        threads.push_back(thread([&, w]() {
+            long n = 0;
+            for (size_t i = w; !done.load(memory_order_relaxed); i += writers) {
+                int key = keys[i % keys.size()];
+                if ((i / keys.size()) % 2) shared.remove(key);
+                else shared.insert(make_pair(key, (int)i));
+                n++;
+            }
+            updates += n;
+        }));
+    }
+
+    Clock::time_point start = Clock::now();
+    this_thread::sleep_for(chrono::milliseconds(300));
+    done = true;
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    Clock::time_point stop = Clock::now();
+    report(name + " update, " + to_string(writers) + " writers", nsPer(start, stop, updates.load()));
+}
+
+void benchSharded(const vector<int>& keys)
+{
+    for (int writers = 1; writers <= 8; writers *= 2) {
+        ConcurrentAVLMap<int, int> single;
+        ShardedMap<int, int> sharded(HashShards<int>(16));
+        benchWriters("ConcurrentAVLMap", single, keys, writers);
+        benchWriters("ShardedMap x16", sharded, keys, writers);
+    }
+
+    // the same updates one at a time and grouped by shard
+    vector< pair<int, int> > batch;
+    for (size_t i = 0; i < keys.size(); i++) batch.push_back(make_pair(keys[i], (int)i));
+    ShardedMap<int, int> loop(HashShards<int>(16)), batched(HashShards<int>(16));
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < batch.size(); i++) loop.insert(batch[i]);
+    Clock::time_point mid = Clock::now();
+    batched.insertBatch(batch.begin(), batch.end());
+    Clock::time_point stop = Clock::now();
+    report("ShardedMap x16 insert, per key", nsPer(start, mid, batch.size()));
+    report("ShardedMap x16 insertBatch", nsPer(mid, stop, batch.size()));
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    mt19937 rng(12345);
+
+    vector<int> keys(n);
+    for (size_t i = 0; i < n; i++) keys[i] = (int)(i * 2);
+    shuffle(keys.begin(), keys.end(), rng);
+
+    // half hits, half misses
+    vector<int> probes(n);
+    for (size_t i = 0; i < n; i++) probes[i] = (int)(rng() % (2 * n));
+
+    cout << "n = " << n << endl;
+    benchLookup< BinarySearchTree<int, int> >("BinarySearchTree<int,int>", keys, probes);
+    benchLookup< AVLTree<int, int> >("AVLTree<int,int>", keys, probes);
+    benchLookup< CompactAVLTree<int, int> >("CompactAVLTree<int,int>", keys, probes);
+    benchLookup< BTreeMap<int, int, 16> >("BTreeMap<int,int,16>", keys, probes);
+    benchLookup< BTreeMap<int, int, 32> >("BTreeMap<int,int,32>", keys, probes);
+    benchLookup< BTreeMap<int, int, 64> >("BTreeMap<int,int,64>", keys, probes);
+    benchFrozen(keys, probes);
+    benchSimdIndex<int>("int", keys, probes);
+    benchSimdIndex<uint32_t>("uint32_t", keys, probes);
+    benchSimdIndex<uint64_t>("uint64_t", keys, probes);
+    benchSimdIndex<double>("double", keys, probes);
+    benchStringKeys< BinarySearchTree<string, int>, BinarySearchTree<string, int, NodePool, CountingLess> >(
+        "BinarySearchTree", keys, probes);
+    benchStringKeys< AVLTree<string, int>, AVLTree<string, int, NodePool, NoAugment, CountingLess> >(
+        "AVLTree", keys, probes);
+    benchScan< BinarySearchTree<int, int> >("BinarySearchTree<int,int>", keys);
+    benchScan< AVLTree<int, int> >("AVLTree<int,int>", keys);
+    benchAppend(n);
+    benchFinger(keys);
+    benchPersistent(keys);
+    for (int readers = 1; readers <= 8; readers *= 2) {
+        benchConcurrent<MutexAVLMap>("mutex AVLTree", keys, readers);
+        benchConcurrent< ConcurrentAVLMap<int, int> >("ConcurrentAVLMap", keys, readers);
+    }
+    benchSharded(keys);
+    benchBatch(keys, n / 100);
+    benchBatch(keys, n);
+    benchUnion(keys);
+
+    return 0;
+}
@@ -40,6 +40,16 @@ int main(int argc, char *argv[])
     bt.print();
     cout << "Binary tree is balanced: " << boolalpha << bt.isBalanced() << endl;
 
+    // Sorted inserts leave a chain; rebalance() folds it back up
+    BinarySearchTree<char,int> chain;
+    for (char c = 'a'; c <= 'g'; c++) {
+        chain.insert(std::make_pair(c, c - 'a'));
+    }
+    cout << "Chain is balanced: " << boolalpha << chain.isBalanced() << endl;
+    chain.rebalance();
+    chain.print();
+    cout << "Rebalanced chain is balanced: " << boolalpha << chain.isBalanced() << endl;
+
     // // AVL Tree Tests
     // AVLTree<char,int> at;
     // at.insert(std::make_pair('a',1));
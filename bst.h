@@ -3,26 +3,37 @@
 
 #include <iostream>
 #include <exception>
+#include <stdexcept>
 #include <cstdlib>
+#include <cmath>
 #include <utility>
+#include <tuple>
+#include <functional>
 #include <algorithm>
+#include <type_traits>
+#include <iterator>
+#include <cstddef>
+#include <vector>
+#include "node-pool.h"
 
 //#define DEBUG
 //#define DEBUG_BALANCE
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * Nothing here is virtual, so nodes carry no vptr and the
+ * getters inline into tight loops. Derived node types
+ * (e.g. AVLNode) hide the getters with versions that return
+ * their own type; which one runs is decided at compile time
+ * by the static type of the pointer.
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    Node(Key&& key, Value&& value, Node<Key, Value>* parent);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -30,15 +41,16 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
     int numChildren() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
+    void setValue(Value&& value);
 
 protected:
     std::pair<const Key, Value> item_;
@@ -66,10 +78,24 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
 
 }
 
+/**
+* A constructor that moves the key and value into the node.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>::Node(Key&& key, Value&& value, Node<Key, Value>* parent) :
+    item_(std::move(key), std::move(value)),
+    parent_(parent),
+    left_(NULL),
+    right_(NULL)
+{
+
+}
+
 /**
 * Destructor, which does not need to do anything since the pointers inside of a node
 * are only used as references to existing nodes. The nodes pointed to by parent/left/right
-* are freed by the BinarySearchTree.
+* are freed by the BinarySearchTree. It is not virtual: the tree always destroys a node
+* through its concrete type (see destroyNode).
 */
 template<typename Key, typename Value>
 Node<Key, Value>::~Node()
@@ -123,7 +149,7 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
@@ -132,7 +158,7 @@ Node<Key, Value>* Node<Key, Value>::getParent() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -141,7 +167,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
@@ -193,6 +219,15 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+/**
+* A setter that moves the new value into the node.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setValue(Value&& value)
+{
+    item_.second = std::move(value);
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
@@ -201,8 +236,15 @@ void Node<Key, Value>::setValue(const Value& value)
 
 /**
 * A templated unbalanced binary search tree.
+* Alloc is the node allocation policy (see node-pool.h); nodes come from
+* a slab pool unless another policy is given.
+* Compare orders the keys, std::less<Key> by default. It must be default
+* constructible: every comparison uses a fresh Compare(). If it is
+* transparent (declares is_transparent, like std::less<>), find, lower_bound,
+* upper_bound, operator[] and remove also take any type it can compare with
+* a Key, e.g. a const char* for std::string keys, without building a Key.
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value, template <typename> class Alloc = NodePool, class Compare = std::less<Key> >
 class BinarySearchTree
 {
 public:
@@ -210,13 +252,26 @@ public:
     virtual ~BinarySearchTree(); //TODO
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
-    void clear(); //TODO
-    bool isBalanced() const; //TODO
+    virtual void clear(); //TODO
+    virtual bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
 
-    template<typename PPKey, typename PPValue>
-    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    // Rebuilds the tree into a perfectly balanced shape in place, in O(n)
+    // time and O(1) extra space. A no-op for trees that keep themselves
+    // balanced.
+    virtual void rebalance();
+    // With c > 1, an insert that lands deeper than c * log2(n) rebuilds
+    // the smallest subtree around it that breaks the same bound, so sorted
+    // or adversarial key orders keep lookups O(log n) at an amortized
+    // O(log n) per insert, as in a scapegoat tree. The closer c is to 1, the
+    // more often it rebuilds; at 1 even a complete tree breaks the bound,
+    // so c must be greater. c = 0 (the default) turns it off. Only the
+    // plain tree uses it; the balanced subclasses never need it.
+    void setAutoRebalance(double c);
+
+    template<typename PPKey, typename PPValue, template <typename> class PPAlloc, class PPCompare>
+    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue, PPAlloc, PPCompare> & tree);
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
@@ -224,6 +279,12 @@ public:
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -233,24 +294,189 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++(); // pre-increment
+        iterator operator++(int); // post-increment
+        iterator& operator--(); // pre-decrement, end() steps to the largest item
+        iterator operator--(int); // post-decrement
+
+    protected:
+        friend class BinarySearchTree<Key, Value, Alloc, Compare>;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Alloc, Compare>* tree);
+        Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Alloc, Compare>* tree_;  // for decrementing end()
+    };
+
+    /**
+    * The same as iterator, but the items are read-only. An iterator
+    * converts to a const_iterator.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Alloc, Compare>;
+        const_iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Alloc, Compare>* tree);
         Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Alloc, Compare>* tree_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    /**
+    * A forward-only iterator that keeps the path of ancestors it still has
+    * to visit on an explicit stack, so stepping never climbs parent
+    * pointers. Faster for full scans, but copying one copies its stack,
+    * and it is invalidated by any change to the tree.
+    */
+    class path_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
+        path_iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const path_iterator& rhs) const;
+        bool operator!=(const path_iterator& rhs) const;
+
+        path_iterator& operator++();
+        path_iterator operator++(int);
+
+    protected:
+        friend class BinarySearchTree<Key, Value, Alloc, Compare>;
+        explicit path_iterator(Node<Key,Value>* root);
+        void pushLeftSpine(Node<Key,Value>* n);
+        // the current node on top, under it the ancestors whose left subtree we are in
+        std::vector<Node<Key, Value>*> path_;
+    };
+
+    /**
+    * The pairs between two iterators, for use in a range-based for loop.
+    * Its end is the node just past the range, so a scan stops there by
+    * comparing node pointers, without comparing any keys.
+    */
+    template<typename It>
+    class BasicRange
+    {
+    public:
+        BasicRange(const It& first, const It& last) : first_(first), last_(last) {}
+        It begin() const { return first_; }
+        It end() const { return last_; }
+        bool empty() const { return first_ == last_; }
+
+    private:
+        It first_;
+        It last_;
     };
+    typedef BasicRange<iterator> Range;
 
 public:
     iterator begin() const;
     iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
+    path_iterator pathBegin() const;
+    path_iterator pathEnd() const;
     iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    Range range(const Key& lo, const Key& hi) const;
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
+    // Insertion that moves or constructs in place rather than copying.
+    // insert overwrites an existing value, like insert(const pair&);
+    // emplace and try_emplace leave it alone; insert_or_assign overwrites.
+    // The bool is true if a new pair went in.
+    void insert(std::pair<const Key, Value>&& keyValuePair);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+    template<typename V>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, V&& value);
+    template<typename V>
+    std::pair<iterator, bool> insert_or_assign(Key&& key, V&& value);
+
+    // Hinted insertion, which overwrites like insert. If the key belongs
+    // right before hint (end() for after the largest key), it is linked
+    // there without a search from the root, in O(1) amortized comparisons
+    // and rebalancing. Otherwise it is a finger search from hint (see
+    // below). append_back(p) is insert(end(), p), the fast path for
+    // increasing keys.
+    iterator insert(const iterator& hint, const std::pair<const Key, Value>& keyValuePair);
+    iterator insert(const iterator& hint, std::pair<const Key, Value>&& keyValuePair);
+    iterator append_back(const std::pair<const Key, Value>& keyValuePair);
+    iterator append_back(std::pair<const Key, Value>&& keyValuePair);
+
+    // Finger search: find and remove that start at hint (end() for the
+    // largest key) instead of the root. The search climbs the parent
+    // pointers only until it reaches a subtree that must hold key, then
+    // descends. erase removes the pair at pos without searching for it at
+    // all, and returns an iterator to the pair after it.
+    iterator find(const iterator& hint, const Key& key) const;
+    void remove(const iterator& hint, const Key& key);
+    iterator erase(const iterator& pos);
+
+    // Heterogeneous lookups, for transparent comparators only.
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    Value& operator[](const K& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    Value const & operator[](const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    void remove(const K& key);
+
 protected:
     // Mandatory helper functions
-    Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    template<typename K>
+    Node<Key, Value>* internalFind(const K& k) const; // TODO
+    template<typename K>
+    Node<Key, Value>* internalFindFrom(Node<Key, Value>* top, const K& key) const;
+    template<typename K>
+    Node<Key, Value>* internalLowerBound(const K& key) const;
+    template<typename K>
+    Node<Key, Value>* internalUpperBound(const K& key) const;
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value> *getLargestNode() const;
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
@@ -260,24 +486,56 @@ protected:
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
 
     // Add helper functions here
+    template<typename A, typename B>
+    static bool keyLess(const A& a, const B& b) { return Compare()(a, b); }
+    virtual void removeNode(Node<Key, Value>* curr);
     static Node<Key, Value>* successor(Node<Key, Value>* current);
+    iterator iteratorAt(Node<Key, Value>* n) const;
+    iterator mutableIterator(const iterator& it) const;
+    iterator mutableIterator(const const_iterator& it) const;
     void clearHelper(Node<Key,Value>* root);
+    Node<Key, Value>* insertionPoint(const Key& key, int& dir) const;
+    Node<Key, Value>* insertionPointFrom(Node<Key, Value>* top, const Key& key, int& dir) const;
+    Node<Key, Value>* fingerTop(Node<Key, Value>* finger, const Key& key) const;
+    Node<Key, Value>* hintedInsertionPoint(Node<Key, Value>* next, const Key& key, int& dir) const;
+    virtual void linkLeaf(Node<Key, Value>* parent, int dir, Node<Key, Value>* n);
+    virtual void valueChanged(Node<Key, Value>* n);
+    template<typename K, typename... Args>
+    std::pair<iterator, bool> tryEmplaceHelper(K&& key, Args&&... args);
+    template<typename K, typename V>
+    std::pair<iterator, bool> assignHelper(K&& key, V&& value);
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    virtual Node<Key, Value>* createNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void destroyNode(Node<Key, Value>* n);
+    virtual bool releaseNodes();
     int isBalancedHelper(Node<Key,Value>* root) const;
     void editParentToRemove(Node<Key,Value>* curr, Node<Key,Value>* parent, Node<Key,Value>* newval);
+    void linkChild(Node<Key, Value>* parent, int dir, Node<Key, Value>* n);
+    void dropFromEnds(Node<Key, Value>* n);
+    void findEnds();
+    void rotateLeft(Node<Key, Value>* x);
+    void rotateRight(Node<Key, Value>* x);
+    void rebuildSubtree(Node<Key, Value>* top);
+    void compressVine(Node<Key, Value>* anchor, int side, std::size_t count);
+    static std::size_t subtreeSize(Node<Key, Value>* top);
 
     // for debugging:
     struct PrintTreeOnDestruct {
-        PrintTreeOnDestruct(BinarySearchTree<Key,Value>* tree) : tree_(tree) {}
+        PrintTreeOnDestruct(BinarySearchTree<Key, Value, Alloc, Compare>* tree) : tree_(tree) {}
         ~PrintTreeOnDestruct() {
             std::cout << "New tree: " << std::endl;
             tree_->print();
         }
-        BinarySearchTree<Key,Value>* tree_;
+        BinarySearchTree<Key, Value, Alloc, Compare>* tree_;
     };
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    Alloc<Node<Key, Value> > alloc_;
+    Node<Key, Value>* min_;     // the smallest and largest nodes, NULL if empty
+    Node<Key, Value>* max_;
+    std::size_t nodeCount_;     // kept by linkLeaf and removeNode, for the auto-rebalance
+    double rebalanceFactor_;    // c in the auto-rebalance bound, 0 if off
 };
 
 /*
@@ -287,11 +545,12 @@ Begin implementations for the BinarySearchTree::iterator class.
 */
 
 /**
-* Explicit constructor that initializes an iterator with a given node pointer.
+* Explicit constructor that initializes an iterator with a given node pointer
+* and the tree it belongs to.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr) :
-    current_(ptr)
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+BinarySearchTree<Key, Value, Alloc, Compare>::iterator::iterator(Node<Key,Value> *ptr, const BinarySearchTree<Key, Value, Alloc, Compare>* tree) :
+    current_(ptr), tree_(tree)
 {
     
 }
@@ -299,9 +558,9 @@ BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr) :
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() :
-    current_(NULL)
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+BinarySearchTree<Key, Value, Alloc, Compare>::iterator::iterator() :
+    current_(NULL), tree_(NULL)
 {
     
 }
@@ -309,9 +568,9 @@ BinarySearchTree<Key, Value>::iterator::iterator() :
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, template <typename> class Alloc, class Compare>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Alloc, Compare>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -319,9 +578,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, template <typename> class Alloc, class Compare>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Alloc, Compare>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -330,10 +589,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, template <typename> class Alloc, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Alloc, Compare>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Alloc, Compare>::iterator& rhs) const
 {
     return this->current_ == rhs.current_;
 }
@@ -342,10 +601,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, template <typename> class Alloc, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Alloc, Compare>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Alloc, Compare>::iterator& rhs) const
 {
     return this->current_ != rhs.current_;
 }
@@ -354,15 +613,45 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator&
+BinarySearchTree<Key, Value, Alloc, Compare>::iterator::operator++()
 {
     // TODO
     current_ = successor(current_);
     return *this;
 }
 
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::iterator::operator++(int)
+{
+    iterator old(*this);
+    current_ = successor(current_);
+    return old;
+}
+
+/**
+* Moves the iterator back using an in-order sequencing. Decrementing
+* end() gives the largest item.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator&
+BinarySearchTree<Key, Value, Alloc, Compare>::iterator::operator--()
+{
+    if (current_ == NULL) current_ = tree_->getLargestNode();
+    else current_ = predecessor(current_);
+    return *this;
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
 
 /*
 -------------------------------------------------------------
@@ -370,6 +659,201 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+-------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+-------------------------------------------------------------------
+*/
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator::const_iterator(Node<Key,Value> *ptr, const BinarySearchTree<Key, Value, Alloc, Compare>* tree) :
+    current_(ptr), tree_(tree)
+{
+
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator::const_iterator() :
+    current_(NULL), tree_(NULL)
+{
+
+}
+
+/**
+* Converts from a non-const iterator at the same position.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator::const_iterator(const iterator& it) :
+    current_(it.current_), tree_(it.tree_)
+{
+
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator::operator*() const
+{
+    return current_->getItem();
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator::operator->() const
+{
+    return &(current_->getItem());
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+bool
+BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return this->current_ == rhs.current_;
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+bool
+BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return this->current_ != rhs.current_;
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator&
+BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator::operator++()
+{
+    current_ = successor(current_);
+    return *this;
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    current_ = successor(current_);
+    return old;
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator&
+BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator::operator--()
+{
+    if (current_ == NULL) current_ = tree_->getLargestNode();
+    else current_ = predecessor(current_);
+    return *this;
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+-----------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+-----------------------------------------------------------------
+*/
+
+/*
+------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::path_iterator class.
+------------------------------------------------------------------
+*/
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator::path_iterator()
+{
+
+}
+
+/**
+* Starts at the smallest item of the subtree at root.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator::path_iterator(Node<Key,Value> *root)
+{
+    path_.reserve(64);
+    pushLeftSpine(root);
+}
+
+/**
+* Pushes n and every left descendant on its left spine, so that the
+* smallest of them ends up on top.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator::pushLeftSpine(Node<Key,Value> *n)
+{
+    for (; n != NULL; n = n->getLeft()) {
+        path_.push_back(n);
+    }
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator::operator*() const
+{
+    return path_.back()->getItem();
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator::operator->() const
+{
+    return &(path_.back()->getItem());
+}
+
+/**
+* Two path iterators are equal when they are at the same node, or
+* both at the end.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+bool
+BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator::operator==(const path_iterator& rhs) const
+{
+    if (path_.empty() || rhs.path_.empty()) return path_.empty() == rhs.path_.empty();
+    return path_.back() == rhs.path_.back();
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+bool
+BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator::operator!=(const path_iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* The next item is the smallest in the current node's right subtree if it
+* has one, otherwise the nearest ancestor still on the stack.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator&
+BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator::operator++()
+{
+    Node<Key, Value>* right = path_.back()->getRight();
+    path_.pop_back();
+    pushLeftSpine(right);
+    return *this;
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator::operator++(int)
+{
+    path_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/*
+----------------------------------------------------------------
+End implementations for the BinarySearchTree::path_iterator class.
+----------------------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -379,14 +863,14 @@ Begin implementations for the BinarySearchTree class.
 /**
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() : root_(NULL)
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+BinarySearchTree<Key, Value, Alloc, Compare>::BinarySearchTree() : root_(NULL), min_(NULL), max_(NULL), nodeCount_(0), rebalanceFactor_(0)
 {
     // TODO
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+BinarySearchTree<Key, Value, Alloc, Compare>::~BinarySearchTree()
 {
     clear();
 }
@@ -394,67 +878,203 @@ BinarySearchTree<Key, Value>::~BinarySearchTree()
 /**
  * Returns true if tree is empty
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+bool BinarySearchTree<Key, Value, Alloc, Compare>::empty() const
 {
     return root_ == NULL;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::print() const
 {
     printRoot(root_);
     std::cout << "\n";
 }
 
+/**
+* Wraps n in an iterator, for subclasses that find nodes on their own.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::iteratorAt(Node<Key, Value>* n) const
+{
+    return iterator(n, this);
+}
+
+/**
+* The iterator at the same place as it, for subclasses whose own iterator
+* type is a const_iterator.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::mutableIterator(const iterator& it) const
+{
+    return it;
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::mutableIterator(const const_iterator& it) const
+{
+    return iterator(it.current_, this);
+}
+
 /**
 * Returns an iterator to the "smallest" item in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value, Alloc, Compare>::iterator begin(getSmallestNode(), this);
     return begin;
 }
 
 /**
 * Returns an iterator whose value means INVALID
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::end() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
+    BinarySearchTree<Key, Value, Alloc, Compare>::iterator end(NULL, this);
     return end;
 }
 
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::cbegin() const
+{
+    return const_iterator(getSmallestNode(), this);
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::const_iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::cend() const
+{
+    return const_iterator(NULL, this);
+}
+
+/**
+* Returns a reverse iterator to the "largest" item in the tree
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
+/**
+* Returns a path_iterator to the "smallest" item in the tree
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::pathBegin() const
+{
+    return path_iterator(root_);
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::path_iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::pathEnd() const
+{
+    return path_iterator();
+}
+
 /**
 * Returns an iterator to the item with the given key, k
 * or the end iterator if k does not exist in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::find(const Key & k) const
 {
     Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
+    BinarySearchTree<Key, Value, Alloc, Compare>::iterator it(curr, this);
     return it;
 }
 
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or the end iterator if there is none
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(internalLowerBound(key), this);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or the end iterator if there is none
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::upper_bound(const Key& key) const
+{
+    return iterator(internalUpperBound(key), this);
+}
+
+/**
+* Returns the lower and upper bound of key, which hold the item with
+* that key between them if it is in the tree
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator, typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator>
+BinarySearchTree<Key, Value, Alloc, Compare>::equal_range(const Key& key) const
+{
+    return std::make_pair(lower_bound(key), upper_bound(key));
+}
+
+/**
+* Returns the items with keys in [lo, hi], found with two descents.
+* Empty if hi < lo.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::Range
+BinarySearchTree<Key, Value, Alloc, Compare>::range(const Key& lo, const Key& hi) const
+{
+    iterator first = lower_bound(lo);
+    if (keyLess(hi, lo)) return Range(first, first);
+    return Range(first, upper_bound(hi));
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
  */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+Value& BinarySearchTree<Key, Value, Alloc, Compare>::operator[](const Key& key)
 {
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+Value const & BinarySearchTree<Key, Value, Alloc, Compare>::operator[](const Key& key) const
 {
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
@@ -462,168 +1082,583 @@ Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 }
 
 /**
-* An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
-* Recall: If key is already in the tree, you should 
-* overwrite the current value with the updated value.
+* The heterogeneous versions of the lookups above: key is compared with
+* the tree's keys as is, never converted to a Key.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::find(const K& key) const
 {
-    Node<Key, Value>* curr = root_;
-    const Key& key = keyValuePair.first;
-    const Value& value = keyValuePair.second;
+    return iterator(internalFind(key), this);
+}
 
-    #ifdef DEBUG
-    std::cout << "Inserting pair (" << key << ", " << value << ")" << std::endl; 
-    PrintTreeOnDestruct p(this);
-    #endif
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::lower_bound(const K& key) const
+{
+    return iterator(internalLowerBound(key), this);
+}
 
-    if (empty()) {
-        root_ = new Node<Key, Value>(key, value, NULL);
-        return;
-    }
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::upper_bound(const K& key) const
+{
+    return iterator(internalUpperBound(key), this);
+}
 
-    // walk the tree
-    while (true) {
-        if (key == curr->getKey()) {
-            curr->setValue(value);
-            return;
-        }
-        if (key < curr->getKey()) {
-            Node<Key, Value>* left = curr->getLeft();
-            if (left == NULL) 
-            {
-                curr->setLeft(new Node<Key, Value>(key, value, curr));
-                #ifdef DEBUG
-                std::cout << "\tInserting as left node" << std::endl;
-                #endif
-                return;
-            }
-            curr = left;
-        }
-        else {
-            Node<Key, Value>* right = curr->getRight();
-            if (right == NULL) 
-            {
-                
-                curr->setRight(new Node<Key, Value>(key, value, curr));
-                #ifdef DEBUG
-                std::cout << "\tInserting as right node" << std::endl;
-                #endif
-                return;
-            }
-            curr = right;
-        }
-    }
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename K, typename C, typename>
+Value& BinarySearchTree<Key, Value, Alloc, Compare>::operator[](const K& key)
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
 }
 
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename K, typename C, typename>
+Value const & BinarySearchTree<Key, Value, Alloc, Compare>::operator[](const K& key) const
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename K, typename C, typename>
+void BinarySearchTree<Key, Value, Alloc, Compare>::remove(const K& key)
+{
+    Node<Key, Value>* curr = internalFind(key);
+    if (curr != NULL) removeNode(curr);
+}
 
 /**
-* A remove method to remove a specific key from a Binary Search Tree.
-* Recall: The writeup specifies that if a node has 2 children you
-* should swap with the predecessor and then remove.
+* An insert method to insert into a Binary Search Tree.
+* The tree will not remain balanced when inserting.
+* Recall: If key is already in the tree, you should 
+* overwrite the current value with the updated value.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
-    Node<Key, Value>* curr = root_;
+    const Key& key = keyValuePair.first;
+    const Value& value = keyValuePair.second;
 
     #ifdef DEBUG
-    std::cout << "Removing node with key " << key << std::endl;
+    std::cout << "Inserting pair (" << key << ", " << value << ")" << std::endl; 
     PrintTreeOnDestruct p(this);
     #endif
 
-    while (curr != NULL) {
-        // found the node.
-        if (curr->getKey() == key) {
-            Node<Key, Value> *left = curr->getLeft(), *right = curr->getRight(), *parent = curr->getParent();
-            bool currIsRoot = (curr == root_);
-
-            // node has two children
-            if (left && right) {
-                #ifdef DEBUG
-                std::cout << "Node has 2 children" << std::endl;
-                #endif
-                // swap with predecessor and delete.
-                Node<Key,Value>* pred = predecessor(curr);
-                nodeSwap(curr, pred);
-                if (currIsRoot) root_ = pred;
-                
-                parent = curr->getParent(); // remember to get new parent
-                
-                // we need to check if predecessor had left child before deleting it.
-                if (curr->getLeft()) {
-                    editParentToRemove(curr, parent, curr->getLeft());
-                    curr->getLeft()->setParent(parent);
-                }
-                else {
-                    editParentToRemove(curr, parent, NULL); 
-                }
-                delete curr;
-                return;
-            }
-            // node only has left child
-            if (curr->getLeft()) {
-                #ifdef DEBUG
-                std::cout << "Node has left child" << std::endl;
-                #endif
-                // check if node is a left or right child of its parent and promote
-                // its left child.
-                if (currIsRoot) {
-                    root_ = curr->getLeft();
-                }
-                else {
-                    editParentToRemove(curr, parent, curr->getLeft());
-                }
-                curr->getLeft()->setParent(parent);
-                delete curr;
-                return;
-            }
-            // node only has right child
-            if (curr->getRight()) {
-                 #ifdef DEBUG
-                std::cout << "Node has right child" << std::endl;
-                 #endif
-                // check if node is a left or right child of its parent and promote
-                // its right child.
-                if (currIsRoot) {
-                    root_ = curr->getRight();
-                } 
-                else {
-                    editParentToRemove(curr, parent, curr->getRight());
-                }
-                curr->getRight()->setParent(parent);
-                delete curr;
-                return;
-            }
+    int dir;
+    Node<Key, Value>* at = insertionPoint(key, dir);
+    if (at != NULL && dir == 0) {
+        at->setValue(value);
+        valueChanged(at);
+        return;
+    }
+    linkLeaf(at, dir, createNode(key, value, at));
+}
 
-            // if we made it here the node must have be a leaf (no children).
-            if (currIsRoot) { // tree only has one node, since root is also a leaf
-                root_ = NULL;
-            }
-            else {
-                editParentToRemove(curr, parent, NULL);
-            }
-            delete curr;
-            return;
-        }
+/**
+* The same as insert(const pair&), but moves the value into the tree. The
+* key is const in the pair, so it is still copied; use try_emplace to move
+* the key as well.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::insert(std::pair<const Key, Value>&& keyValuePair)
+{
+    int dir;
+    Node<Key, Value>* at = insertionPoint(keyValuePair.first, dir);
+    if (at != NULL && dir == 0) {
+        at->setValue(std::move(keyValuePair.second));
+        valueChanged(at);
+        return;
+    }
+    linkLeaf(at, dir, createNode(Key(keyValuePair.first), std::move(keyValuePair.second), at));
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::insert(const iterator& hint, const std::pair<const Key, Value>& keyValuePair)
+{
+    int dir;
+    Node<Key, Value>* at = hintedInsertionPoint(hint.current_, keyValuePair.first, dir);
+    if (at != NULL && dir == 0) {
+        at->setValue(keyValuePair.second);
+        valueChanged(at);
+        return iteratorAt(at);
+    }
+    Node<Key, Value>* n = createNode(keyValuePair.first, keyValuePair.second, at);
+    linkLeaf(at, dir, n);
+    return iteratorAt(n);
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::insert(const iterator& hint, std::pair<const Key, Value>&& keyValuePair)
+{
+    int dir;
+    Node<Key, Value>* at = hintedInsertionPoint(hint.current_, keyValuePair.first, dir);
+    if (at != NULL && dir == 0) {
+        at->setValue(std::move(keyValuePair.second));
+        valueChanged(at);
+        return iteratorAt(at);
+    }
+    Node<Key, Value>* n = createNode(Key(keyValuePair.first), std::move(keyValuePair.second), at);
+    linkLeaf(at, dir, n);
+    return iteratorAt(n);
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::append_back(const std::pair<const Key, Value>& keyValuePair)
+{
+    return insert(end(), keyValuePair);
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::append_back(std::pair<const Key, Value>&& keyValuePair)
+{
+    return insert(end(), std::move(keyValuePair));
+}
+
+/**
+* Finger search for key from hint. O(log d) comparisons, for a key d
+* positions away from hint, when no much taller ancestor separates them:
+* the climb stops at the lowest subtree that holds both, and the descent
+* from there is as long as the climb. Two neighbours on either side of the
+* root are the worst case, about twice a search from the root.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::find(const iterator& hint, const Key& key) const
+{
+    Node<Key, Value>* finger = (hint.current_ != NULL) ? hint.current_ : max_;
+    return iterator(internalFindFrom(fingerTop(finger, key), key), this);
+}
+
+/**
+* remove(key), with a finger search from hint (see find(hint, key)).
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::remove(const iterator& hint, const Key& key)
+{
+    Node<Key, Value>* finger = (hint.current_ != NULL) ? hint.current_ : max_;
+    Node<Key, Value>* curr = internalFindFrom(fingerTop(finger, key), key);
+    if (curr != NULL) removeNode(curr);
+}
+
+/**
+* Removes the pair at pos, which must be a valid iterator into this tree
+* (end() is ignored). Nodes keep their pairs through the restructuring, so
+* the successor found beforehand is still the next pair afterwards.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator
+BinarySearchTree<Key, Value, Alloc, Compare>::erase(const iterator& pos)
+{
+    Node<Key, Value>* curr = pos.current_;
+    if (curr == NULL) return end();
+    Node<Key, Value>* next = successor(curr);
+    removeNode(curr);
+    return iteratorAt(next);
+}
+
+/**
+* Constructs a pair from args, as std::pair's constructors would, and moves
+* it into the tree unless its key is already there. The pair is built
+* before the search, since the search needs its key.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Compare>::emplace(Args&&... args)
+{
+    std::pair<Key, Value> item(std::forward<Args>(args)...);
+    int dir;
+    Node<Key, Value>* at = insertionPoint(item.first, dir);
+    if (at != NULL && dir == 0) return std::make_pair(iteratorAt(at), false);
+    Node<Key, Value>* n = createNode(std::move(item.first), std::move(item.second), at);
+    linkLeaf(at, dir, n);
+    return std::make_pair(iteratorAt(n), true);
+}
+
+/**
+* If key is not in the tree, inserts it with a value constructed from args.
+* Otherwise does nothing: args are not touched, so they are not moved from.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Compare>::try_emplace(const Key& key, Args&&... args)
+{
+    return tryEmplaceHelper(key, std::forward<Args>(args)...);
+}
 
-        // keep walking the tree
-        if (key < curr->getKey()) {
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Compare>::try_emplace(Key&& key, Args&&... args)
+{
+    return tryEmplaceHelper(std::move(key), std::forward<Args>(args)...);
+}
+
+/**
+* Assigns value to key's pair if key is in the tree, or inserts a new pair.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename V>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Compare>::insert_or_assign(const Key& key, V&& value)
+{
+    return assignHelper(key, std::forward<V>(value));
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename V>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Compare>::insert_or_assign(Key&& key, V&& value)
+{
+    return assignHelper(std::move(key), std::forward<V>(value));
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename K, typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Compare>::tryEmplaceHelper(K&& key, Args&&... args)
+{
+    int dir;
+    Node<Key, Value>* at = insertionPoint(key, dir);
+    if (at != NULL && dir == 0) return std::make_pair(iteratorAt(at), false);
+    std::pair<Key, Value> item(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+    Node<Key, Value>* n = createNode(std::move(item.first), std::move(item.second), at);
+    linkLeaf(at, dir, n);
+    return std::make_pair(iteratorAt(n), true);
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+template<typename K, typename V>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Compare>::assignHelper(K&& key, V&& value)
+{
+    int dir;
+    Node<Key, Value>* at = insertionPoint(key, dir);
+    if (at != NULL && dir == 0) {
+        at->getValue() = std::forward<V>(value);
+        valueChanged(at);
+        return std::make_pair(iteratorAt(at), false);
+    }
+    Key k(std::forward<K>(key));
+    Value v(std::forward<V>(value));
+    Node<Key, Value>* n = createNode(std::move(k), std::move(v), at);
+    linkLeaf(at, dir, n);
+    return std::make_pair(iteratorAt(n), true);
+}
+
+/**
+* Where key belongs in the tree. If key is there, returns its node and sets
+* dir to 0. Otherwise returns the node a new leaf for key would hang from,
+* with dir -1 for its left side and 1 for its right, or NULL if the tree is
+* empty. Like internalFind, one comparison per level, and one equality test
+* at the end.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Compare>::insertionPoint(const Key& key, int& dir) const
+{
+    return insertionPointFrom(root_, key, dir);
+}
+
+/**
+* insertionPoint, searching only the subtree at top, which must be where
+* key belongs (see fingerTop).
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Compare>::insertionPointFrom(Node<Key, Value>* top, const Key& key, int& dir) const
+{
+    Node<Key, Value>* curr = top;
+    Node<Key, Value>* parent = NULL;
+    Node<Key, Value>* candidate = NULL;  // the last node not greater than key
+    dir = 0;
+    while (curr != NULL) {
+        parent = curr;
+        if (keyLess(key, curr->getKey())) {
+            dir = -1;
             curr = curr->getLeft();
         }
         else {
+            dir = 1;
+            candidate = curr;
             curr = curr->getRight();
         }
     }
+    if (candidate != NULL && !keyLess(candidate->getKey(), key)) {
+        dir = 0;
+        return candidate;
+    }
+    return parent;
+}
+
+/**
+* insertionPoint for a key that probably belongs right before next (after
+* the largest key if next is NULL). If it lies between next and its
+* predecessor, or equals one of them, the answer comes from those two
+* nodes alone: next's empty left slot if it has one, else the
+* predecessor's empty right slot. Otherwise it is a finger search from
+* next.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Alloc, Compare>::hintedInsertionPoint(Node<Key, Value>* next, const Key& key, int& dir) const
+{
+    if (next != NULL && !keyLess(key, next->getKey())) {
+        if (keyLess(next->getKey(), key)) return insertionPointFrom(fingerTop(next, key), key, dir);
+        dir = 0;
+        return next;
+    }
+    Node<Key, Value>* prev = (next != NULL) ? predecessor(next) : max_;
+    if (prev != NULL && !keyLess(prev->getKey(), key)) {
+        if (keyLess(key, prev->getKey())) return insertionPointFrom(fingerTop(prev, key), key, dir);
+        dir = 0;
+        return prev;
+    }
+
+    if (next != NULL && next->getLeft() == NULL) {
+        dir = -1;
+        return next;
+    }
+    dir = 1;
+    return prev;
+}
+
+/**
+* The root of the smallest subtree around finger that must hold key, or
+* key's own node if the climb passes it. For key > finger, the subtrees
+* on finger's path up all start below key; each ends at the first
+* ancestor it is a left subtree of. The climb compares key with those
+* ancestors only, and stops at the first that is greater than key. The
+* subtree is then the one just above the previous such ancestor, or finger
+* itself if there was none. key < finger is the mirror image. The root if
+* finger is NULL.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Compare>::fingerTop(Node<Key, Value>* finger, const Key& key) const
+{
+    if (finger == NULL) return root_;
+    Node<Key, Value>* best = finger;
+    Node<Key, Value>* curr = finger;
+    if (keyLess(key, finger->getKey())) {
+        for (Node<Key, Value>* p = curr->getParent(); p != NULL; curr = p, p = p->getParent()) {
+            if (curr != p->getRight()) continue;
+            if (!keyLess(key, p->getKey())) return keyLess(p->getKey(), key) ? best : p;
+            best = p;
+        }
+    }
+    else if (keyLess(finger->getKey(), key)) {
+        for (Node<Key, Value>* p = curr->getParent(); p != NULL; curr = p, p = p->getParent()) {
+            if (curr != p->getLeft()) continue;
+            if (!keyLess(p->getKey(), key)) return keyLess(key, p->getKey()) ? best : p;
+            best = p;
+        }
+    }
+    return best;
+}
+
+/**
+* Hangs the new leaf n from parent on side dir (see insertionPoint), or
+* makes it the root if parent is NULL. AVLTree rebalances here.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::linkLeaf(Node<Key, Value>* parent, int dir, Node<Key, Value>* n)
+{
+    linkChild(parent, dir, n);
+    nodeCount_++;
+    if (rebalanceFactor_ <= 0) return;
+
+    std::size_t depth = 0;
+    for (Node<Key, Value>* p = parent; p != NULL; p = p->getParent()) depth++;
+    if (depth <= rebalanceFactor_ * std::log2((double)nodeCount_)) return;
+
+    // walk up to the first ancestor whose subtree is too deep for its size;
+    // the root is one, since the whole tree is
+    std::size_t size = 1, height = 0;
+    Node<Key, Value>* curr = n;
+    while (curr != root_) {
+        Node<Key, Value>* p = curr->getParent();
+        Node<Key, Value>* sibling = (p->getLeft() == curr) ? p->getRight() : p->getLeft();
+        size += 1 + subtreeSize(sibling);
+        height++;
+        curr = p;
+        if (height > rebalanceFactor_ * std::log2((double)size)) break;
+    }
+    rebuildSubtree(curr);
+}
+
+/**
+* Hangs n below parent on the dir side, or makes it the root if parent is
+* NULL. n's parent pointer must already be set.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::linkChild(Node<Key, Value>* parent, int dir, Node<Key, Value>* n)
+{
+    if (parent == NULL) {
+        root_ = n;
+        min_ = max_ = n;
+    }
+    else if (dir < 0) {
+        parent->setLeft(n);
+        if (parent == min_) min_ = n;
+    }
+    else {
+        parent->setRight(n);
+        if (parent == max_) max_ = n;
+    }
+}
+
+/**
+* Moves min_ and max_ off n, which is about to be removed. Nodes keep their
+* pairs when the tree is restructured, so this is the only time they move
+* inward.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::dropFromEnds(Node<Key, Value>* n)
+{
+    if (n == min_) min_ = successor(n);
+    if (n == max_) max_ = predecessor(n);
+}
+
+/**
+* Sets min_ and max_ from scratch, in O(height), for operations that relink
+* whole subtrees at once.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::findEnds()
+{
+    min_ = max_ = root_;
+    if (root_ == NULL) return;
+    while (min_->getLeft() != NULL) min_ = min_->getLeft();
+    while (max_->getRight() != NULL) max_ = max_->getRight();
+}
+
+/**
+* Called after n's value is overwritten in place. AVLTree refreshes the
+* augment values above it here.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::valueChanged(Node<Key, Value>* n)
+{
+
+}
+
+
+/**
+* A remove method to remove a specific key from a Binary Search Tree.
+* Recall: The writeup specifies that if a node has 2 children you
+* should swap with the predecessor and then remove.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::remove(const Key& key)
+{
+    #ifdef DEBUG
+    std::cout << "Removing node with key " << key << std::endl;
+    PrintTreeOnDestruct p(this);
+    #endif
+
+    Node<Key, Value>* curr = internalFind(key);
+    if (curr != NULL) {
+        removeNode(curr);
+        return;
+    }
     #ifdef DEBUG
     std::cout << "Node not found, couldn't remove" << std::endl;
     #endif
 }
 
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::editParentToRemove(Node<Key,Value>* curr, Node<Key,Value>* parent, Node<Key,Value>* newval)
+/**
+* Unlinks and destroys curr. AVLTree rebalances after.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::removeNode(Node<Key, Value>* curr)
+{
+    nodeCount_--;
+    dropFromEnds(curr);
+    Node<Key, Value> *left = curr->getLeft(), *right = curr->getRight(), *parent = curr->getParent();
+    bool currIsRoot = (curr == root_);
+
+    // node has two children
+    if (left && right) {
+        #ifdef DEBUG
+        std::cout << "Node has 2 children" << std::endl;
+        #endif
+        // swap with predecessor and delete.
+        Node<Key,Value>* pred = predecessor(curr);
+        nodeSwap(curr, pred);
+        if (currIsRoot) root_ = pred;
+        
+        parent = curr->getParent(); // remember to get new parent
+        
+        // we need to check if predecessor had left child before deleting it.
+        if (curr->getLeft()) {
+            editParentToRemove(curr, parent, curr->getLeft());
+            curr->getLeft()->setParent(parent);
+        }
+        else {
+            editParentToRemove(curr, parent, NULL); 
+        }
+        destroyNode(curr);
+        return;
+    }
+    // node only has left child
+    if (curr->getLeft()) {
+        #ifdef DEBUG
+        std::cout << "Node has left child" << std::endl;
+        #endif
+        // check if node is a left or right child of its parent and promote
+        // its left child.
+        if (currIsRoot) {
+            root_ = curr->getLeft();
+        }
+        else {
+            editParentToRemove(curr, parent, curr->getLeft());
+        }
+        curr->getLeft()->setParent(parent);
+        destroyNode(curr);
+        return;
+    }
+    // node only has right child
+    if (curr->getRight()) {
+         #ifdef DEBUG
+        std::cout << "Node has right child" << std::endl;
+         #endif
+        // check if node is a left or right child of its parent and promote
+        // its right child.
+        if (currIsRoot) {
+            root_ = curr->getRight();
+        } 
+        else {
+            editParentToRemove(curr, parent, curr->getRight());
+        }
+        curr->getRight()->setParent(parent);
+        destroyNode(curr);
+        return;
+    }
+
+    // if we made it here the node must have be a leaf (no children).
+    if (currIsRoot) { // tree only has one node, since root is also a leaf
+        root_ = NULL;
+    }
+    else {
+        editParentToRemove(curr, parent, NULL);
+    }
+    destroyNode(curr);
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::editParentToRemove(Node<Key,Value>* curr, Node<Key,Value>* parent, Node<Key,Value>* newval)
 {
     if (parent->getLeft() == curr) {
         parent->setLeft(newval);
@@ -634,9 +1669,9 @@ void BinarySearchTree<Key, Value>::editParentToRemove(Node<Key,Value>* curr, Nod
 }
 
 
-template<class Key, class Value>
+template<class Key, class Value, template <typename> class Alloc, class Compare>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value, Alloc, Compare>::predecessor(Node<Key, Value>* current)
 {
     Node<Key, Value>* left = current->getLeft();
     
@@ -662,9 +1697,9 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
     }
 }
 
-template<class Key, class Value>
+template<class Key, class Value, template <typename> class Alloc, class Compare>
 Node<Key, Value>* 
-BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value, Alloc, Compare>::successor(Node<Key, Value>* current)
 {
     Node<Key, Value>* right = current->getRight();
     
@@ -694,65 +1729,339 @@ BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::clear()
 {
-    clearHelper(root_);
+    // with a pooled allocator, whole slabs can be dropped without walking the tree
+    if (!releaseNodes()) {
+        clearHelper(root_);
+    }
     root_ = NULL;
+    min_ = max_ = NULL;
+    nodeCount_ = 0;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clearHelper(Node<Key,Value>* root)
+/**
+* Destroys the subtree at root in O(1) extra space, however deep it is.
+* While the top node has a left child, a right rotation lifts that child
+* above it; once it has none, it is destroyed and its right child becomes
+* the top. Each rotation moves one node onto the right spine for good, so
+* there are fewer rotations than nodes. Parent pointers are not kept up,
+* since every node goes.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::clearHelper(Node<Key,Value>* root)
+{
+    while (root != NULL) {
+        Node<Key, Value>* left = root->getLeft();
+        if (left != NULL) {
+            root->setLeft(left->getRight());
+            left->setRight(root);
+            root = left;
+        }
+        else {
+            Node<Key, Value>* right = root->getRight();
+            destroyNode(root);
+            root = right;
+        }
+    }
+}
+
+/**
+* Allocates and constructs a node from the tree's allocation policy.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Compare>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    Node<Key, Value>* n = alloc_.allocate();
+    try {
+        return new (n) Node<Key, Value>(key, value, parent);
+    }
+    catch (...) {
+        alloc_.deallocate(n);
+        throw;
+    }
+}
+
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Compare>::createNode(Key&& key, Value&& value, Node<Key, Value>* parent)
+{
+    Node<Key, Value>* n = alloc_.allocate();
+    try {
+        return new (n) Node<Key, Value>(std::move(key), std::move(value), parent);
+    }
+    catch (...) {
+        alloc_.deallocate(n);
+        throw;
+    }
+}
+
+/**
+* Destroys a node and returns its storage to the allocation policy.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::destroyNode(Node<Key, Value>* n)
+{
+    n->~Node();
+    alloc_.deallocate(n);
+}
+
+/**
+* Frees every node at once if the policy supports it and skipping the
+* destructors is harmless. Returns false if the caller must walk the tree.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+bool BinarySearchTree<Key, Value, Alloc, Compare>::releaseNodes()
+{
+    if (!std::is_trivially_destructible< std::pair<const Key, Value> >::value) return false;
+    return alloc_.releaseAll();
+}
+
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::rebalance()
+{
+    if (root_ != NULL) rebuildSubtree(root_);
+}
+
+/**
+* Throws std::invalid_argument unless c is 0 or greater than 1: for any
+* other value not even a perfectly balanced tree is shallow enough, and a
+* negative or NaN c makes no sense.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::setAutoRebalance(double c)
+{
+    if (c != 0 && !(c > 1)) {
+        throw std::invalid_argument("setAutoRebalance: c must be 0 or greater than 1");
+    }
+    rebalanceFactor_ = c;
+}
+
+/**
+* Rotates x's right child up into x's place.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::rotateLeft(Node<Key, Value>* x)
+{
+    Node<Key, Value>* y = x->getRight();
+    Node<Key, Value>* p = x->getParent();
+    x->setRight(y->getLeft());
+    if (y->getLeft() != NULL) y->getLeft()->setParent(x);
+    y->setLeft(x);
+    x->setParent(y);
+    y->setParent(p);
+    if (p == NULL) root_ = y;
+    else editParentToRemove(x, p, y);
+}
+
+/**
+* Rotates x's left child up into x's place.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::rotateRight(Node<Key, Value>* x)
+{
+    Node<Key, Value>* y = x->getLeft();
+    Node<Key, Value>* p = x->getParent();
+    x->setLeft(y->getRight());
+    if (y->getRight() != NULL) y->getRight()->setParent(x);
+    y->setRight(x);
+    x->setParent(y);
+    y->setParent(p);
+    if (p == NULL) root_ = y;
+    else editParentToRemove(x, p, y);
+}
+
+/**
+* Day-Stout-Warren: rebuilds the subtree at top into a complete tree, in
+* O(n) time and O(1) extra space. Right rotations first straighten it into
+* a vine, a chain of right children, counting its n nodes on the way. Left
+* rotations of every other vine node then fold it up: once for the nodes
+* past the largest 2^k - 1, so the bottom level fills from the left, then
+* with half as many rotations each pass until the vine is gone.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::rebuildSubtree(Node<Key, Value>* top)
+{
+    Node<Key, Value>* anchor = top->getParent();
+    int side = (anchor == NULL) ? 0 : ((anchor->getLeft() == top) ? -1 : 1);
+
+    std::size_t n = 0;
+    Node<Key, Value>* curr = top;
+    while (curr != NULL) {
+        Node<Key, Value>* left = curr->getLeft();
+        if (left != NULL) {
+            rotateRight(curr);
+            curr = left;
+        }
+        else {
+            n++;
+            curr = curr->getRight();
+        }
+    }
+
+    std::size_t full = 1;
+    while (full * 2 + 1 <= n) full = full * 2 + 1;
+    compressVine(anchor, side, n - full);
+    for (std::size_t m = full / 2; m > 0; m /= 2) {
+        compressVine(anchor, side, m);
+    }
+}
+
+/**
+* Rotates the first count nodes at even positions of the vine hanging on
+* anchor's side (the root if anchor is NULL) left, each above its successor.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::compressVine(Node<Key, Value>* anchor, int side, std::size_t count)
+{
+    Node<Key, Value>* scanner = (anchor == NULL) ? root_ : ((side < 0) ? anchor->getLeft() : anchor->getRight());
+    for (std::size_t i = 0; i < count; i++) {
+        Node<Key, Value>* child = scanner->getRight();
+        rotateLeft(scanner);
+        scanner = child->getRight();
+    }
+}
+
+/**
+* The number of nodes in the subtree at top, counted along the parent
+* pointers without a stack.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+std::size_t BinarySearchTree<Key, Value, Alloc, Compare>::subtreeSize(Node<Key, Value>* top)
 {
-    if (!root) return;
-    clearHelper(root->getLeft());
-    clearHelper(root->getRight());
-    delete root;
+    if (top == NULL) return 0;
+    std::size_t count = 0;
+    Node<Key, Value>* stop = top->getParent();
+    Node<Key, Value>* prev = stop;
+    Node<Key, Value>* curr = top;
+    while (curr != stop) {
+        Node<Key, Value>* next;
+        if (prev == curr->getParent()) {
+            count++;
+            if (curr->getLeft()) next = curr->getLeft();
+            else if (curr->getRight()) next = curr->getRight();
+            else next = curr->getParent();
+        }
+        else if (prev == curr->getLeft() && curr->getRight()) {
+            next = curr->getRight();
+        }
+        else {
+            next = curr->getParent();
+        }
+        prev = curr;
+        curr = next;
+    }
+    return count;
 }
 
 /**
 * A helper function to find the smallest node in the tree.
 */
-template<typename Key, typename Value>
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+BinarySearchTree<Key, Value, Alloc, Compare>::getSmallestNode() const
 {
-    if (empty()) return NULL;
-    Node<Key, Value>* curr = root_;
-    while (curr->getLeft() != NULL) {
-        curr = curr->getLeft();
-    }
-    return curr;
+    return min_;
+}
+
+/**
+* Helper function to find the "largest" node in the tree,
+* or NULL if it is empty
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Alloc, Compare>::getLargestNode() const
+{
+    return max_;
 }
 
 /**
 * Helper function to find a node with given key, k and
 * return a pointer to it or NULL if no item with that key
-* exists
+* exists.
+* One comparison per level: the walk finds the last node whose key is not
+* greater than k, and only that node is tested for equality, at the end.
+* It always runs down to a leaf rather than stopping at a match, which
+* costs about one extra level but halves the comparisons on the way.
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Compare>::internalFind(const K& key) const
+{
+    return internalFindFrom(root_, key);
+}
+
+/**
+* internalFind, searching only the subtree at top (see fingerTop).
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Compare>::internalFindFrom(Node<Key, Value>* top, const K& key) const
+{
+    Node<Key, Value>* curr = top;
+    Node<Key, Value>* candidate = NULL;
+    while (curr != NULL) {
+        if (keyLess(key, curr->getKey())) {
+            curr = curr->getLeft();
+        }
+        else {
+            candidate = curr;
+            curr = curr->getRight();
+        }
+    }
+    if (candidate != NULL && !keyLess(candidate->getKey(), key)) return candidate;
+    return NULL;
+}
+
+/**
+* Helper function to find the first node whose key is not
+* less than key, or NULL if there is none
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Compare>::internalLowerBound(const K& key) const
 {
     Node<Key, Value>* curr = root_;
+    Node<Key, Value>* result = NULL;
     while (curr != NULL) {
-        if (key == curr->getKey()) {
-            return curr;
+        if (keyLess(curr->getKey(), key)) {
+            curr = curr->getRight();
         }
-        if (key < curr->getKey()) {
+        else {
+            result = curr;
+            curr = curr->getLeft();
+        }
+    }
+    return result;
+}
+
+/**
+* Helper function to find the first node whose key is
+* greater than key, or NULL if there is none
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Compare>::internalUpperBound(const K& key) const
+{
+    Node<Key, Value>* curr = root_;
+    Node<Key, Value>* result = NULL;
+    while (curr != NULL) {
+        if (keyLess(key, curr->getKey())) {
+            result = curr;
             curr = curr->getLeft();
         }
         else {
             curr = curr->getRight();
         }
     }
-    return NULL;
+    return result;
 }
 
 /**
  * Return true iff the BST is balanced.
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+bool BinarySearchTree<Key, Value, Alloc, Compare>::isBalanced() const
 {
     #ifdef DEBUG_BALANCE
     print();
@@ -761,22 +2070,55 @@ bool BinarySearchTree<Key, Value>::isBalanced() const
 }
 
 
-template<typename Key, typename Value>
-int BinarySearchTree<Key, Value>::isBalancedHelper(Node<Key,Value>* root) const
+/**
+* Returns the height of the subtree at root, or -1 if some node in it has
+* children whose heights differ by more than one. A post-order walk along
+* the parent pointers, so it needs no call stack; the heights of finished
+* subtrees wait on an explicit stack until their parent is done.
+*/
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+int BinarySearchTree<Key, Value, Alloc, Compare>::isBalancedHelper(Node<Key,Value>* root) const
 {
     if (!root) return 0;
 
-    int leftTree = isBalancedHelper(root->getLeft());
-    int rightTree = isBalancedHelper(root->getRight());
-    if (leftTree == -1 || rightTree == -1) return -1;
+    std::vector<int> heights;
+    Node<Key, Value>* curr = root;
+    int done = 0;   // how many of curr's children are finished
+    while (true) {
+        if (done == 0) {
+            if (curr->getLeft()) {
+                curr = curr->getLeft();
+                continue;
+            }
+            heights.push_back(0);
+            done = 1;
+        }
+        if (done == 1) {
+            if (curr->getRight()) {
+                curr = curr->getRight();
+                done = 0;
+                continue;
+            }
+            heights.push_back(0);
+        }
 
-    if (std::abs(leftTree - rightTree) > 1) return -1;
-    return std::max(leftTree, rightTree) + 1;
+        int rightTree = heights.back();
+        heights.pop_back();
+        int leftTree = heights.back();
+        heights.pop_back();
+        if (std::abs(leftTree - rightTree) > 1) return -1;
+        heights.push_back(std::max(leftTree, rightTree) + 1);
+
+        if (curr == root) return heights.back();
+        Node<Key, Value>* parent = curr->getParent();
+        done = (curr == parent->getLeft()) ? 1 : 2;
+        curr = parent;
+    }
 }
 
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+template<typename Key, typename Value, template <typename> class Alloc, class Compare>
+void BinarySearchTree<Key, Value, Alloc, Compare>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
@@ -0,0 +1,127 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include "btree-map.h"
+
+using namespace std;
+
+// Randomized test for BTreeMap.
+// Run with: ./btree-map-test [ops]
+//
+// Random inserts and removes go into a BTreeMap and a std::map, and the
+// tree must pass isBalanced() (node occupancy, key order and bounds, equal
+// leaf depths) after every one of them. The contents, walked forward and
+// backward along the leaf links, and a few lookups are compared against the
+// std::map every few hundred steps. The key range widens and narrows so the
+// tree grows several levels and then shrinks back to nothing, splitting,
+// borrowing and merging on the way. Each MaxKeys runs separately: 4 gives
+// the most splits and merges, 5 has an odd split point, 32 is the default.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+template<typename Tree>
+static bool same(const Tree& t, const map<int, int>& m)
+{
+    vector< pair<int, int> > expect(m.begin(), m.end()), got;
+    for (typename Tree::iterator it = t.begin(); it != t.end(); ++it) got.push_back(*it);
+    if (got != expect || t.size() != m.size() || t.empty() != m.empty()) return false;
+    got.clear();
+    if (!t.empty()) {
+        typename Tree::iterator it = t.end();
+        do {
+            --it;
+            got.push_back(*it);
+        } while (it != t.begin());
+    }
+    return got == vector< pair<int, int> >(expect.rbegin(), expect.rend());
+}
+
+template<typename Tree>
+static bool lookups(const Tree& t, const map<int, int>& m, mt19937& rng, int range)
+{
+    for (int probe = 0; probe < 20; probe++) {
+        int key = (int)(rng() % (range + 2)) - 1;
+        map<int, int>::const_iterator e = m.find(key);
+        typename Tree::iterator it = t.find(key);
+        if ((e == m.end()) != (it == t.end())) return false;
+        if (e != m.end() && (it->second != e->second || t[key] != e->second)) return false;
+        map<int, int>::const_iterator lb = m.lower_bound(key);
+        it = t.lower_bound(key);
+        if ((lb == m.end()) != (it == t.end())) return false;
+        if (lb != m.end() && it->first != lb->first) return false;
+    }
+    return true;
+}
+
+template<unsigned MaxKeys>
+static void testRandom(int ops)
+{
+    mt19937 rng(17);
+    BTreeMap<int, int, MaxKeys> t;
+    map<int, int> m;
+    bool balanced = true;
+    for (int i = 0; i < ops; i++) {
+        // grow through the first half, then shrink the range to drain it
+        int range = (i < ops / 2) ? 10 + i / 4 : 10 + (ops - i) / 8;
+        int key = (int)(rng() % range);
+        if (i < ops / 2 ? rng() % 3 != 0 : rng() % 3 == 0) {
+            t.insert(make_pair(key, i));
+            m[key] = i;
+        }
+        else {
+            t.remove(key);
+            m.erase(key);
+        }
+        balanced = balanced && t.isBalanced() && t.size() == m.size();
+        if (i % 499 == 0) {
+            check(same(t, m), "contents against std::map");
+            check(lookups(t, m, rng, range), "lookups against std::map");
+        }
+    }
+    check(balanced, "isBalanced() after every insert and remove");
+    check(same(t, m), "final contents");
+
+    // remove what is left, in random order
+    vector<int> keys;
+    for (map<int, int>::iterator it = m.begin(); it != m.end(); ++it) keys.push_back(it->first);
+    shuffle(keys.begin(), keys.end(), rng);
+    for (size_t k = 0; k < keys.size(); k++) {
+        t.remove(keys[k]);
+        m.erase(keys[k]);
+        balanced = balanced && t.isBalanced();
+    }
+    check(balanced && t.empty() && t.begin() == t.end() && same(t, m), "removing every key");
+
+    // sorted inserts, the worst case for splits, then clear
+    for (int k = 0; k < 5000; k++) {
+        t.insert(make_pair(k, k));
+        m[k] = k;
+    }
+    check(t.isBalanced() && same(t, m), "sorted inserts");
+    t.clear();
+    check(t.empty() && t.isBalanced() && t.begin() == t.end(), "clear");
+    cout << ops << " random ops, MaxKeys " << MaxKeys << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int ops = (argc > 1) ? atoi(argv[1]) : 30000;
+
+    testRandom<4>(ops);
+    testRandom<5>(ops);
+    testRandom<32>(ops);
+
+    cout << "Failures: " << failures << endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,844 @@
+#ifndef BTREE_MAP_H
+#define BTREE_MAP_H
+
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+* A fixed array of N slots for T, constructed and destroyed one at a time.
+* B-tree nodes keep their keys and pairs in these, so neither Key nor
+* Value needs a default constructor, and pairs with a const key can still
+* be shifted around (by move-constructing them into the next slot).
+*/
+template <typename T, unsigned N>
+class BTreeSlots
+{
+public:
+    T& operator[](unsigned i) { return *reinterpret_cast<T*>(&data_[i]); }
+    const T& operator[](unsigned i) const { return *reinterpret_cast<const T*>(&data_[i]); }
+
+    void construct(unsigned i, const T& value) { new (&data_[i]) T(value); }
+    void destroy(unsigned from, unsigned to);
+    void insertAt(unsigned i, unsigned count, const T& value);
+    void eraseAt(unsigned i, unsigned count);
+    void moveTo(unsigned from, unsigned to, BTreeSlots<T, N>& dst, unsigned at);
+
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type data_[N];
+};
+
+template<typename T, unsigned N>
+void BTreeSlots<T, N>::destroy(unsigned from, unsigned to)
+{
+    for (unsigned i = from; i < to; i++) (*this)[i].~T();
+}
+
+/**
+* Inserts value at i, shifting the count constructed slots from i on up by
+* one.
+*/
+template<typename T, unsigned N>
+void BTreeSlots<T, N>::insertAt(unsigned i, unsigned count, const T& value)
+{
+    for (unsigned j = count; j > i; j--) {
+        new (&data_[j]) T(std::move((*this)[j - 1]));
+        (*this)[j - 1].~T();
+    }
+    new (&data_[i]) T(value);
+}
+
+/**
+* Destroys slot i and shifts the slots after it, up to count, down by one.
+*/
+template<typename T, unsigned N>
+void BTreeSlots<T, N>::eraseAt(unsigned i, unsigned count)
+{
+    (*this)[i].~T();
+    for (unsigned j = i; j + 1 < count; j++) {
+        new (&data_[j]) T(std::move((*this)[j + 1]));
+        (*this)[j + 1].~T();
+    }
+}
+
+/**
+* Moves slots [from, to) into dst starting at slot at. The source slots are
+* left unconstructed.
+*/
+template<typename T, unsigned N>
+void BTreeSlots<T, N>::moveTo(unsigned from, unsigned to, BTreeSlots<T, N>& dst, unsigned at)
+{
+    for (unsigned i = from; i < to; i++, at++) {
+        new (&dst.data_[at]) T(std::move((*this)[i]));
+        (*this)[i].~T();
+    }
+}
+
+
+/**
+* An ordered map stored as a B+ tree, with the same interface as
+* BinarySearchTree.
+*
+* Each node holds up to MaxKeys keys in a sorted array, so a lookup touches
+* one node per level, about log_{MaxKeys/2}(n) of them, and searches each
+* node with a binary search over contiguous keys, instead of chasing one
+* pointer (and likely one cache miss) per key compared. The pairs are all in
+* the leaves, which are linked both ways, so iteration walks the leaf arrays
+* in order. Inner nodes only hold separator keys. Every node but the root
+* stays at least half full, and all leaves are at the same depth.
+*
+* MaxKeys between 16 and 64 suits most key types; larger nodes mean fewer
+* levels but more data moved per insert and remove. Inserting or removing a
+* pair invalidates every iterator into the map.
+*/
+template <typename Key, typename Value, unsigned MaxKeys = 32>
+class BTreeMap
+{
+    static_assert(MaxKeys >= 4, "BTreeMap nodes need at least 4 keys");
+
+protected:
+    static const unsigned MinKeys = MaxKeys / 2;
+
+    // nodes may hold one key too many until the caller splits them
+    struct BTreeNode {
+        bool leaf;
+        unsigned count;     // keys in an inner node, pairs in a leaf
+    };
+    struct BTreeLeaf : BTreeNode {
+        BTreeSlots<std::pair<const Key, Value>, MaxKeys + 1> items;
+        BTreeLeaf* prev;
+        BTreeLeaf* next;
+    };
+    struct BTreeInner : BTreeNode {
+        // keys in children[i] < keys[i] <= keys in children[i + 1]
+        BTreeSlots<Key, MaxKeys + 1> keys;
+        BTreeNode* children[MaxKeys + 2];
+    };
+
+public:
+    typedef std::pair<const Key, Value> value_type;
+
+    BTreeMap();
+    ~BTreeMap();
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool isBalanced() const;
+    void print() const;
+    bool empty() const;
+    std::size_t size() const;
+
+    /**
+    * Steps through the pairs in key order, one leaf array at a time.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
+        iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--(); // end() steps to the largest item
+        iterator operator--(int);
+
+    protected:
+        friend class BTreeMap<Key, Value, MaxKeys>;
+        iterator(BTreeLeaf* leaf, unsigned index, const BTreeMap<Key, Value, MaxKeys>* tree);
+        BTreeLeaf* leaf_;
+        unsigned index_;
+        const BTreeMap<Key, Value, MaxKeys>* tree_;  // for decrementing end()
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    BTreeLeaf* findLeaf(const Key& key) const;
+    BTreeLeaf* edgeLeaf(bool rightmost) const;
+    static unsigned leafLowerBound(const BTreeLeaf* leaf, const Key& key);
+    static unsigned childIndex(const BTreeInner* inner, const Key& key);
+
+    bool insertInto(BTreeNode* n, const std::pair<const Key, Value>& keyValuePair);
+    void splitChild(BTreeInner* parent, unsigned i);
+    bool removeFrom(BTreeNode* n, const Key& key);
+    void fixChild(BTreeInner* parent, unsigned i);
+    void borrowFromLeft(BTreeInner* parent, unsigned i);
+    void borrowFromRight(BTreeInner* parent, unsigned i);
+    void mergeChildren(BTreeInner* parent, unsigned i);
+
+    static BTreeLeaf* createLeaf();
+    static BTreeInner* createInner();
+    static void destroyNode(BTreeNode* n);
+    static void clearHelper(BTreeNode* n);
+    bool checkNode(const BTreeNode* n, int depth, int& leafDepth, const Key* lo, const Key* hi) const;
+
+    BTreeNode* root_;
+    std::size_t size_;
+
+private:
+    // not copyable
+    BTreeMap(const BTreeMap<Key, Value, MaxKeys>& other);
+    BTreeMap<Key, Value, MaxKeys>& operator=(const BTreeMap<Key, Value, MaxKeys>& other);
+};
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the BTreeMap::iterator class.
+  -----------------------------------------------------
+*/
+
+template<class Key, class Value, unsigned MaxKeys>
+BTreeMap<Key, Value, MaxKeys>::iterator::iterator() :
+    leaf_(NULL),
+    index_(0),
+    tree_(NULL)
+{
+
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+BTreeMap<Key, Value, MaxKeys>::iterator::iterator(BTreeLeaf* leaf, unsigned index, const BTreeMap<Key, Value, MaxKeys>* tree) :
+    leaf_(leaf),
+    index_(index),
+    tree_(tree)
+{
+
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+std::pair<const Key,Value>& BTreeMap<Key, Value, MaxKeys>::iterator::operator*() const
+{
+    return leaf_->items[index_];
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+std::pair<const Key,Value>* BTreeMap<Key, Value, MaxKeys>::iterator::operator->() const
+{
+    return &(leaf_->items[index_]);
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+bool BTreeMap<Key, Value, MaxKeys>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+bool BTreeMap<Key, Value, MaxKeys>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::iterator& BTreeMap<Key, Value, MaxKeys>::iterator::operator++()
+{
+    if (++index_ == leaf_->count) {
+        leaf_ = leaf_->next;
+        index_ = 0;
+    }
+    return *this;
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::iterator BTreeMap<Key, Value, MaxKeys>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::iterator& BTreeMap<Key, Value, MaxKeys>::iterator::operator--()
+{
+    if (leaf_ == NULL) {
+        leaf_ = tree_->edgeLeaf(true);
+        index_ = leaf_->count - 1;
+    }
+    else if (index_ == 0) {
+        leaf_ = leaf_->prev;
+        index_ = leaf_->count - 1;
+    }
+    else {
+        index_--;
+    }
+    return *this;
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::iterator BTreeMap<Key, Value, MaxKeys>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the BTreeMap::iterator class.
+  ---------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the BTreeMap class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value, unsigned MaxKeys>
+BTreeMap<Key, Value, MaxKeys>::BTreeMap() :
+    root_(NULL),
+    size_(0)
+{
+
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+BTreeMap<Key, Value, MaxKeys>::~BTreeMap()
+{
+    clear();
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+bool BTreeMap<Key, Value, MaxKeys>::empty() const
+{
+    return root_ == NULL;
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+std::size_t BTreeMap<Key, Value, MaxKeys>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::iterator BTreeMap<Key, Value, MaxKeys>::begin() const
+{
+    return iterator(edgeLeaf(false), 0, this);
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::iterator BTreeMap<Key, Value, MaxKeys>::end() const
+{
+    return iterator(NULL, 0, this);
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::iterator BTreeMap<Key, Value, MaxKeys>::find(const Key& key) const
+{
+    BTreeLeaf* leaf = findLeaf(key);
+    if (leaf == NULL) return end();
+    unsigned i = leafLowerBound(leaf, key);
+    if (i == leaf->count || key < leaf->items[i].first) return end();
+    return iterator(leaf, i, this);
+}
+
+/**
+* If every pair in the leaf is smaller than key, the answer is the first
+* pair of the next leaf: its separator in some ancestor is greater than key.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::iterator BTreeMap<Key, Value, MaxKeys>::lower_bound(const Key& key) const
+{
+    BTreeLeaf* leaf = findLeaf(key);
+    if (leaf == NULL) return end();
+    unsigned i = leafLowerBound(leaf, key);
+    if (i == leaf->count) return iterator(leaf->next, 0, this);
+    return iterator(leaf, i, this);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, unsigned MaxKeys>
+Value& BTreeMap<Key, Value, MaxKeys>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+Value const & BTreeMap<Key, Value, MaxKeys>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* The leaf whose range covers key, or NULL if the map is empty.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::BTreeLeaf* BTreeMap<Key, Value, MaxKeys>::findLeaf(const Key& key) const
+{
+    BTreeNode* n = root_;
+    if (n == NULL) return NULL;
+    while (!n->leaf) {
+        BTreeInner* inner = static_cast<BTreeInner*>(n);
+        n = inner->children[childIndex(inner, key)];
+    }
+    return static_cast<BTreeLeaf*>(n);
+}
+
+/**
+* The leftmost or rightmost leaf, or NULL if the map is empty.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::BTreeLeaf* BTreeMap<Key, Value, MaxKeys>::edgeLeaf(bool rightmost) const
+{
+    BTreeNode* n = root_;
+    if (n == NULL) return NULL;
+    while (!n->leaf) {
+        BTreeInner* inner = static_cast<BTreeInner*>(n);
+        n = inner->children[rightmost ? inner->count : 0];
+    }
+    return static_cast<BTreeLeaf*>(n);
+}
+
+/**
+* The position of the first pair in leaf not less than key.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+unsigned BTreeMap<Key, Value, MaxKeys>::leafLowerBound(const BTreeLeaf* leaf, const Key& key)
+{
+    unsigned lo = 0, hi = leaf->count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (leaf->items[mid].first < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+* The child of inner whose range covers key: the number of separators not
+* greater than key.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+unsigned BTreeMap<Key, Value, MaxKeys>::childIndex(const BTreeInner* inner, const Key& key)
+{
+    unsigned lo = 0, hi = inner->count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (key < inner->keys[mid]) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+/**
+* An insert method for the B-tree. If the key already exists, its value is
+* overwritten. A node that overflows is split by its parent on the way back
+* up, and a root that overflows gets a new root above it.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+void BTreeMap<Key, Value, MaxKeys>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    if (root_ == NULL) {
+        BTreeLeaf* leaf = createLeaf();
+        leaf->items.construct(0, keyValuePair);
+        leaf->count = 1;
+        root_ = leaf;
+        size_ = 1;
+        return;
+    }
+    if (insertInto(root_, keyValuePair)) size_++;
+    if (root_->count > MaxKeys) {
+        BTreeInner* root = createInner();
+        root->children[0] = root_;
+        root_ = root;
+        splitChild(root, 0);
+    }
+}
+
+/**
+* Inserts into the subtree at n, returning whether the key was new. n itself
+* may be left one key over full, for its parent to split.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+bool BTreeMap<Key, Value, MaxKeys>::insertInto(BTreeNode* n, const std::pair<const Key, Value>& keyValuePair)
+{
+    if (n->leaf) {
+        BTreeLeaf* leaf = static_cast<BTreeLeaf*>(n);
+        unsigned i = leafLowerBound(leaf, keyValuePair.first);
+        if (i < leaf->count && !(keyValuePair.first < leaf->items[i].first)) {
+            leaf->items[i].second = keyValuePair.second;
+            return false;
+        }
+        leaf->items.insertAt(i, leaf->count, keyValuePair);
+        leaf->count++;
+        return true;
+    }
+
+    BTreeInner* inner = static_cast<BTreeInner*>(n);
+    unsigned i = childIndex(inner, keyValuePair.first);
+    bool inserted = insertInto(inner->children[i], keyValuePair);
+    if (inner->children[i]->count > MaxKeys) splitChild(inner, i);
+    return inserted;
+}
+
+/**
+* Splits the over-full child i of parent in two halves. A leaf's separator
+* is the first key of its new right half, which stays in the leaf; an inner
+* node's middle key moves up into parent.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+void BTreeMap<Key, Value, MaxKeys>::splitChild(BTreeInner* parent, unsigned i)
+{
+    BTreeNode* child = parent->children[i];
+    unsigned mid = child->count / 2;
+    BTreeNode* right;
+
+    if (child->leaf) {
+        BTreeLeaf* left = static_cast<BTreeLeaf*>(child);
+        BTreeLeaf* leaf = createLeaf();
+        left->items.moveTo(mid, left->count, leaf->items, 0);
+        leaf->count = left->count - mid;
+        left->count = mid;
+        leaf->prev = left;
+        leaf->next = left->next;
+        if (leaf->next) leaf->next->prev = leaf;
+        left->next = leaf;
+        parent->keys.insertAt(i, parent->count, leaf->items[0].first);
+        right = leaf;
+    }
+    else {
+        BTreeInner* left = static_cast<BTreeInner*>(child);
+        BTreeInner* inner = createInner();
+        left->keys.moveTo(mid + 1, left->count, inner->keys, 0);
+        for (unsigned j = mid + 1; j <= left->count; j++) {
+            inner->children[j - mid - 1] = left->children[j];
+        }
+        inner->count = left->count - mid - 1;
+        parent->keys.insertAt(i, parent->count, left->keys[mid]);
+        left->keys.destroy(mid, mid + 1);
+        left->count = mid;
+        right = inner;
+    }
+
+    for (unsigned j = parent->count + 1; j > i + 1; j--) {
+        parent->children[j] = parent->children[j - 1];
+    }
+    parent->children[i + 1] = right;
+    parent->count++;
+}
+
+/**
+* A remove method to remove a specific key from the B-tree. Does nothing
+* if the key is not in the tree. A node left under half full borrows from
+* or merges with a sibling, and a root left with one child is replaced by
+* it.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+void BTreeMap<Key, Value, MaxKeys>::remove(const Key& key)
+{
+    if (root_ == NULL || !removeFrom(root_, key)) return;
+    size_--;
+    if (root_->count == 0) {
+        BTreeNode* old = root_;
+        root_ = old->leaf ? NULL : static_cast<BTreeInner*>(old)->children[0];
+        destroyNode(old);
+    }
+}
+
+/**
+* Removes key from the subtree at n, returning whether it was there. n
+* itself may be left under half full, for its parent to fix.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+bool BTreeMap<Key, Value, MaxKeys>::removeFrom(BTreeNode* n, const Key& key)
+{
+    if (n->leaf) {
+        BTreeLeaf* leaf = static_cast<BTreeLeaf*>(n);
+        unsigned i = leafLowerBound(leaf, key);
+        if (i == leaf->count || key < leaf->items[i].first) return false;
+        leaf->items.eraseAt(i, leaf->count);
+        leaf->count--;
+        return true;
+    }
+
+    BTreeInner* inner = static_cast<BTreeInner*>(n);
+    unsigned i = childIndex(inner, key);
+    if (!removeFrom(inner->children[i], key)) return false;
+    if (inner->children[i]->count < MinKeys) fixChild(inner, i);
+    return true;
+}
+
+/**
+* Refills the under-full child i of parent from a sibling that can spare a
+* key, or else merges it with one.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+void BTreeMap<Key, Value, MaxKeys>::fixChild(BTreeInner* parent, unsigned i)
+{
+    if (i > 0 && parent->children[i - 1]->count > MinKeys) {
+        borrowFromLeft(parent, i);
+    }
+    else if (i < parent->count && parent->children[i + 1]->count > MinKeys) {
+        borrowFromRight(parent, i);
+    }
+    else if (i > 0) {
+        mergeChildren(parent, i - 1);
+    }
+    else {
+        mergeChildren(parent, i);
+    }
+}
+
+/**
+* Moves the last key of child i - 1 into child i. For inner nodes the key
+* rotates through the separator between them.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+void BTreeMap<Key, Value, MaxKeys>::borrowFromLeft(BTreeInner* parent, unsigned i)
+{
+    if (parent->children[i]->leaf) {
+        BTreeLeaf* left = static_cast<BTreeLeaf*>(parent->children[i - 1]);
+        BTreeLeaf* child = static_cast<BTreeLeaf*>(parent->children[i]);
+        child->items.insertAt(0, child->count, left->items[left->count - 1]);
+        child->count++;
+        left->items.destroy(left->count - 1, left->count);
+        left->count--;
+        parent->keys[i - 1] = child->items[0].first;
+    }
+    else {
+        BTreeInner* left = static_cast<BTreeInner*>(parent->children[i - 1]);
+        BTreeInner* child = static_cast<BTreeInner*>(parent->children[i]);
+        child->keys.insertAt(0, child->count, parent->keys[i - 1]);
+        for (unsigned j = child->count + 1; j > 0; j--) {
+            child->children[j] = child->children[j - 1];
+        }
+        child->children[0] = left->children[left->count];
+        child->count++;
+        parent->keys[i - 1] = left->keys[left->count - 1];
+        left->keys.destroy(left->count - 1, left->count);
+        left->count--;
+    }
+}
+
+/**
+* Moves the first key of child i + 1 into child i.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+void BTreeMap<Key, Value, MaxKeys>::borrowFromRight(BTreeInner* parent, unsigned i)
+{
+    if (parent->children[i]->leaf) {
+        BTreeLeaf* child = static_cast<BTreeLeaf*>(parent->children[i]);
+        BTreeLeaf* right = static_cast<BTreeLeaf*>(parent->children[i + 1]);
+        right->items.moveTo(0, 1, child->items, child->count);
+        child->count++;
+        right->items.moveTo(1, right->count, right->items, 0);
+        right->count--;
+        parent->keys[i] = right->items[0].first;
+    }
+    else {
+        BTreeInner* child = static_cast<BTreeInner*>(parent->children[i]);
+        BTreeInner* right = static_cast<BTreeInner*>(parent->children[i + 1]);
+        child->keys.construct(child->count, parent->keys[i]);
+        child->children[child->count + 1] = right->children[0];
+        child->count++;
+        parent->keys[i] = right->keys[0];
+        right->keys.eraseAt(0, right->count);
+        for (unsigned j = 0; j < right->count; j++) {
+            right->children[j] = right->children[j + 1];
+        }
+        right->count--;
+    }
+}
+
+/**
+* Merges child i + 1 of parent into child i, along with the separator
+* between them if they are inner nodes, and deletes child i + 1.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+void BTreeMap<Key, Value, MaxKeys>::mergeChildren(BTreeInner* parent, unsigned i)
+{
+    if (parent->children[i]->leaf) {
+        BTreeLeaf* left = static_cast<BTreeLeaf*>(parent->children[i]);
+        BTreeLeaf* right = static_cast<BTreeLeaf*>(parent->children[i + 1]);
+        right->items.moveTo(0, right->count, left->items, left->count);
+        left->count += right->count;
+        right->count = 0;
+        left->next = right->next;
+        if (left->next) left->next->prev = left;
+        destroyNode(right);
+    }
+    else {
+        BTreeInner* left = static_cast<BTreeInner*>(parent->children[i]);
+        BTreeInner* right = static_cast<BTreeInner*>(parent->children[i + 1]);
+        left->keys.construct(left->count, parent->keys[i]);
+        right->keys.moveTo(0, right->count, left->keys, left->count + 1);
+        for (unsigned j = 0; j <= right->count; j++) {
+            left->children[left->count + 1 + j] = right->children[j];
+        }
+        left->count += right->count + 1;
+        right->count = 0;
+        destroyNode(right);
+    }
+
+    parent->keys.eraseAt(i, parent->count);
+    for (unsigned j = i + 1; j < parent->count; j++) {
+        parent->children[j] = parent->children[j + 1];
+    }
+    parent->count--;
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::BTreeLeaf* BTreeMap<Key, Value, MaxKeys>::createLeaf()
+{
+    BTreeLeaf* leaf = new BTreeLeaf;
+    leaf->leaf = true;
+    leaf->count = 0;
+    leaf->prev = NULL;
+    leaf->next = NULL;
+    return leaf;
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+typename BTreeMap<Key, Value, MaxKeys>::BTreeInner* BTreeMap<Key, Value, MaxKeys>::createInner()
+{
+    BTreeInner* inner = new BTreeInner;
+    inner->leaf = false;
+    inner->count = 0;
+    return inner;
+}
+
+/**
+* Destroys the keys or pairs still in n, then n itself.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+void BTreeMap<Key, Value, MaxKeys>::destroyNode(BTreeNode* n)
+{
+    if (n->leaf) {
+        BTreeLeaf* leaf = static_cast<BTreeLeaf*>(n);
+        leaf->items.destroy(0, leaf->count);
+        delete leaf;
+    }
+    else {
+        BTreeInner* inner = static_cast<BTreeInner*>(n);
+        inner->keys.destroy(0, inner->count);
+        delete inner;
+    }
+}
+
+/**
+* A method to remove all contents of the tree and
+* reset the values in the tree for use again.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+void BTreeMap<Key, Value, MaxKeys>::clear()
+{
+    if (root_ != NULL) clearHelper(root_);
+    root_ = NULL;
+    size_ = 0;
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+void BTreeMap<Key, Value, MaxKeys>::clearHelper(BTreeNode* n)
+{
+    if (!n->leaf) {
+        BTreeInner* inner = static_cast<BTreeInner*>(n);
+        for (unsigned j = 0; j <= inner->count; j++) clearHelper(inner->children[j]);
+    }
+    destroyNode(n);
+}
+
+/**
+* Checks the B-tree invariants: every leaf at the same depth, every node but
+* the root at least half full, keys sorted, and every key within the range
+* its ancestors' separators give it.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+bool BTreeMap<Key, Value, MaxKeys>::isBalanced() const
+{
+    int leafDepth = -1;
+    return root_ == NULL || checkNode(root_, 0, leafDepth, NULL, NULL);
+}
+
+template<class Key, class Value, unsigned MaxKeys>
+bool BTreeMap<Key, Value, MaxKeys>::checkNode(const BTreeNode* n, int depth, int& leafDepth, const Key* lo, const Key* hi) const
+{
+    if (n->count > MaxKeys || (n != root_ && n->count < MinKeys) || n->count == 0) return false;
+    if (n->leaf) {
+        const BTreeLeaf* leaf = static_cast<const BTreeLeaf*>(n);
+        if (leafDepth == -1) leafDepth = depth;
+        if (depth != leafDepth) return false;
+        for (unsigned j = 0; j < leaf->count; j++) {
+            const Key& key = leaf->items[j].first;
+            if (j > 0 && !(leaf->items[j - 1].first < key)) return false;
+            if ((lo && key < *lo) || (hi && !(key < *hi))) return false;
+        }
+        return true;
+    }
+
+    const BTreeInner* inner = static_cast<const BTreeInner*>(n);
+    for (unsigned j = 0; j <= inner->count; j++) {
+        if (j > 0 && j < inner->count && !(inner->keys[j - 1] < inner->keys[j])) return false;
+        const Key* childLo = (j == 0) ? lo : &inner->keys[j - 1];
+        const Key* childHi = (j == inner->count) ? hi : &inner->keys[j];
+        if (!checkNode(inner->children[j], depth + 1, leafDepth, childLo, childHi)) return false;
+    }
+    return true;
+}
+
+/**
+* Prints the tree one level per line, each node's keys in brackets.
+*/
+template<class Key, class Value, unsigned MaxKeys>
+void BTreeMap<Key, Value, MaxKeys>::print() const
+{
+    std::vector<const BTreeNode*> level;
+    if (root_ != NULL) level.push_back(root_);
+    while (!level.empty()) {
+        std::vector<const BTreeNode*> below;
+        for (std::size_t i = 0; i < level.size(); i++) {
+            std::cout << "[";
+            if (level[i]->leaf) {
+                const BTreeLeaf* leaf = static_cast<const BTreeLeaf*>(level[i]);
+                for (unsigned j = 0; j < leaf->count; j++) {
+                    std::cout << (j ? " " : "") << leaf->items[j].first;
+                }
+            }
+            else {
+                const BTreeInner* inner = static_cast<const BTreeInner*>(level[i]);
+                for (unsigned j = 0; j < inner->count; j++) {
+                    std::cout << (j ? " " : "") << inner->keys[j];
+                }
+                for (unsigned j = 0; j <= inner->count; j++) below.push_back(inner->children[j]);
+            }
+            std::cout << "] ";
+        }
+        std::cout << std::endl;
+        level.swap(below);
+    }
+}
+
+/*
+  -------------------------------------------
+  End implementations for the BTreeMap class.
+  -------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,143 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <random>
+#include <stdexcept>
+#include <cstdlib>
+#include "compact-avl.h"
+
+using namespace std;
+
+// Randomized test for CompactAVLTree.
+// Run with: ./compact-avl-test [ops]
+//
+// Mirrors random inserts and removes in a std::map and after each step
+// checks the links of every node (parents, children, key order), the
+// balance factors and the contents. Removes relocate the last node of the
+// array into the hole, so the link check covers that path on nearly every
+// step. Values are strings that count their copies: growing the array and
+// relocating a node must move them, never copy.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+struct Counted
+{
+    static long copies;
+    string s;
+
+    Counted() {}
+    explicit Counted(const string& str) : s(str) {}
+    Counted(const Counted& other) : s(other.s) { copies++; }
+    Counted(Counted&& other) : s(std::move(other.s)) {}
+    Counted& operator=(const Counted& other) { s = other.s; copies++; return *this; }
+    Counted& operator=(Counted&& other) { s = std::move(other.s); return *this; }
+};
+
+long Counted::copies = 0;
+
+typedef CompactAVLTree<int, Counted> Tree;
+
+// Walks the array directly, so it sees every node whether or not the tree
+// still reaches it.
+class ProbeTree : public Tree
+{
+public:
+    // -1 if the links are inconsistent, otherwise the height of the subtree
+    int checkLinks(uint32_t n, uint32_t parent, const int* lo, const int* hi, uint32_t& count) const
+    {
+        if (n == NIL) return 0;
+        if (n >= size_ || node(n).getParent() != parent) return -1;
+        int key = node(n).getKey();
+        if ((lo && key <= *lo) || (hi && key >= *hi)) return -1;
+        count++;
+        int l = checkLinks(node(n).getLeft(), n, lo, &key, count);
+        int r = checkLinks(node(n).getRight(), n, &key, hi, count);
+        if (l == -1 || r == -1 || node(n).getBalance() != r - l) return -1;
+        return std::max(l, r) + 1;
+    }
+
+    bool valid() const
+    {
+        uint32_t count = 0;
+        return checkLinks(root_, NIL, NULL, NULL, count) != -1 && count == size_;
+    }
+
+    uint32_t capacity() const { return capacity_; }
+};
+
+static bool same(const Tree& t, const map<int, string>& m)
+{
+    map<int, string>::const_iterator e = m.begin();
+    for (Tree::iterator it = t.begin(); it != t.end(); ++it, ++e) {
+        if (e == m.end() || e->first != it->first || e->second != it->second.s) return false;
+    }
+    return e == m.end() && t.size() == m.size();
+}
+
+int main(int argc, char* argv[])
+{
+    int ops = (argc > 1) ? atoi(argv[1]) : 200000;
+    mt19937 rng(42);
+
+    ProbeTree t;
+    map<int, string> m;
+    for (int i = 0; i < ops; i++) {
+        int key = (int)(rng() % 2000);
+        if (rng() % 3) {
+            string value = "value " + to_string(i) + " of a string too long for SSO";
+            t.insert(make_pair(key, Counted(value)));
+            m[key] = value;
+        }
+        else {
+            t.remove(key);
+            m.erase(key);
+        }
+        if (i % 97 == 0 || i < 2000) {
+            check(t.valid(), "links and balances");
+            check(same(t, m), "contents");
+        }
+    }
+    check(t.valid() && same(t, m), "final contents");
+    check(t.isBalanced(), "isBalanced");
+    cout << ops << " random ops, " << m.size() << " keys" << endl;
+
+    // neither growing the array nor relocating on remove copies a value
+    long copiesBefore = Counted::copies;
+    t.reserve(t.capacity() * 4);
+    check(Counted::copies == copiesBefore, "reserve moves the values");
+    for (map<int, string>::iterator it = m.begin(); it != m.end(); ) {
+        t.remove(it->first);
+        it = m.erase(it);
+        if (it != m.end()) ++it;
+    }
+    check(Counted::copies == copiesBefore, "remove moves the relocated value");
+    check(t.valid() && same(t, m), "contents after removes");
+
+    // growth from empty through many doublings keeps everything reachable
+    t.clear();
+    for (int k = 0; k < 100000; k++) {
+        t.insert(make_pair(k, Counted("x")));
+    }
+    check(t.size() == 100000 && t.valid(), "growth by doubling");
+    check(t.find(99999) != t.end() && t.find(100000) == t.end(), "find after growth");
+
+    bool threw = false;
+    try {
+        t.reserve((size_t)Tree::NIL + 1);
+    }
+    catch (const length_error&) {
+        threw = true;
+    }
+    check(threw, "reserve past the node limit throws length_error");
+
+    cout << "Failures: " << failures << endl;
+    return failures ? 1 : 0;
+}
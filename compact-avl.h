@@ -0,0 +1,781 @@
+#ifndef COMPACT_AVL_H
+#define COMPACT_AVL_H
+
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <algorithm>
+
+/**
+* A node of a CompactAVLTree. Instead of pointers it links to other nodes by
+* their 32-bit index in the tree's node array, and the balance (-1, 0, +1) is
+* packed into the top two bits of the parent index. An AVLNode<int,int> is
+* 40 bytes; a CompactAVLNode<int,int> is 20.
+*/
+template <typename Key, typename Value>
+class CompactAVLNode
+{
+public:
+    static const uint32_t NIL = 0x3FFFFFFF;   // "no node"; also the node limit
+
+    CompactAVLNode(const Key& key, const Value& value, uint32_t parent);
+
+    const std::pair<const Key, Value>& getItem() const;
+    std::pair<const Key, Value>& getItem();
+    const Key& getKey() const;
+    const Value& getValue() const;
+    Value& getValue();
+    void setValue(const Value& value);
+
+    uint32_t getParent() const;
+    uint32_t getLeft() const;
+    uint32_t getRight() const;
+    int8_t getBalance() const;
+
+    void setParent(uint32_t parent);
+    void setLeft(uint32_t left);
+    void setRight(uint32_t right);
+    void setBalance(int8_t balance);
+
+private:
+    static const uint32_t INDEX_MASK = 0x3FFFFFFF;
+    static const int BALANCE_SHIFT = 30;
+
+    std::pair<const Key, Value> item_;
+    uint32_t parentAndBalance_;     // low 30 bits: parent, high 2 bits: balance + 1
+    uint32_t left_;
+    uint32_t right_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the CompactAVLNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+CompactAVLNode<Key, Value>::CompactAVLNode(const Key& key, const Value& value, uint32_t parent) :
+    item_(key, value),
+    parentAndBalance_(parent | (1u << BALANCE_SHIFT)),
+    left_(NIL),
+    right_(NIL)
+{
+
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& CompactAVLNode<Key, Value>::getItem() const
+{
+    return item_;
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>& CompactAVLNode<Key, Value>::getItem()
+{
+    return item_;
+}
+
+template<class Key, class Value>
+const Key& CompactAVLNode<Key, Value>::getKey() const
+{
+    return item_.first;
+}
+
+template<class Key, class Value>
+const Value& CompactAVLNode<Key, Value>::getValue() const
+{
+    return item_.second;
+}
+
+template<class Key, class Value>
+Value& CompactAVLNode<Key, Value>::getValue()
+{
+    return item_.second;
+}
+
+template<class Key, class Value>
+void CompactAVLNode<Key, Value>::setValue(const Value& value)
+{
+    item_.second = value;
+}
+
+template<class Key, class Value>
+uint32_t CompactAVLNode<Key, Value>::getParent() const
+{
+    return parentAndBalance_ & INDEX_MASK;
+}
+
+template<class Key, class Value>
+uint32_t CompactAVLNode<Key, Value>::getLeft() const
+{
+    return left_;
+}
+
+template<class Key, class Value>
+uint32_t CompactAVLNode<Key, Value>::getRight() const
+{
+    return right_;
+}
+
+template<class Key, class Value>
+int8_t CompactAVLNode<Key, Value>::getBalance() const
+{
+    return (int8_t)(parentAndBalance_ >> BALANCE_SHIFT) - 1;
+}
+
+template<class Key, class Value>
+void CompactAVLNode<Key, Value>::setParent(uint32_t parent)
+{
+    parentAndBalance_ = (parentAndBalance_ & ~INDEX_MASK) | parent;
+}
+
+template<class Key, class Value>
+void CompactAVLNode<Key, Value>::setLeft(uint32_t left)
+{
+    left_ = left;
+}
+
+template<class Key, class Value>
+void CompactAVLNode<Key, Value>::setRight(uint32_t right)
+{
+    right_ = right;
+}
+
+template<class Key, class Value>
+void CompactAVLNode<Key, Value>::setBalance(int8_t balance)
+{
+    parentAndBalance_ = (parentAndBalance_ & INDEX_MASK) | ((uint32_t)(balance + 1) << BALANCE_SHIFT);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the CompactAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVL tree whose nodes live in one contiguous array and link to each other
+* by index. Removing a node moves the last node of the array into the hole, so
+* the array stays dense: memory use is size() * sizeof(CompactAVLNode) plus
+* the growth slack. Node indices (and so iterators) are invalidated by remove.
+* At most 2^30 - 1 nodes.
+*/
+template <typename Key, typename Value>
+class CompactAVLTree
+{
+public:
+    typedef CompactAVLNode<Key, Value> NodeType;
+    static const uint32_t NIL = NodeType::NIL;
+
+    CompactAVLTree();
+    ~CompactAVLTree();
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    void reserve(std::size_t n);
+    bool isBalanced() const;
+    bool empty() const;
+    std::size_t size() const;
+
+    /**
+    * An iterator over the tree in key order.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++(); // pre-increment
+
+    protected:
+        friend class CompactAVLTree<Key, Value>;
+        iterator(const CompactAVLTree<Key, Value>* tree, uint32_t index);
+        const CompactAVLTree<Key, Value>* tree_;
+        uint32_t current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    uint32_t internalFind(const Key& key) const;
+    uint32_t successor(uint32_t current) const;
+    uint32_t predecessor(uint32_t current) const;
+
+    void rotateLeft(uint32_t x);
+    void rotateRight(uint32_t z);
+    void replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild);
+    void insertFix(uint32_t p, int8_t side);
+    void removeFix(uint32_t p, int8_t side);
+    void relocate(uint32_t from, uint32_t to);
+    uint32_t newNode(const Key& key, const Value& value, uint32_t parent);
+    int isBalancedHelper(uint32_t root) const;
+
+    NodeType& node(uint32_t i) const { return nodes_[i]; }
+
+private:
+    CompactAVLTree(const CompactAVLTree&);
+    CompactAVLTree& operator=(const CompactAVLTree&);
+
+protected:
+    NodeType* nodes_;
+    uint32_t size_;
+    uint32_t capacity_;
+    uint32_t root_;
+};
+
+/*
+----------------------------------------------------------
+Begin implementations for the CompactAVLTree::iterator class.
+----------------------------------------------------------
+*/
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::iterator::iterator(const CompactAVLTree<Key, Value>* tree, uint32_t index) :
+    tree_(tree),
+    current_(index)
+{
+
+}
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::iterator::iterator() :
+    tree_(NULL),
+    current_(NIL)
+{
+
+}
+
+template<class Key, class Value>
+std::pair<const Key,Value> &
+CompactAVLTree<Key, Value>::iterator::operator*() const
+{
+    return tree_->node(current_).getItem();
+}
+
+template<class Key, class Value>
+std::pair<const Key,Value> *
+CompactAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(tree_->node(current_).getItem());
+}
+
+template<class Key, class Value>
+bool
+CompactAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<class Key, class Value>
+bool
+CompactAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator&
+CompactAVLTree<Key, Value>::iterator::operator++()
+{
+    current_ = tree_->successor(current_);
+    return *this;
+}
+
+/*
+--------------------------------------------------------
+End implementations for the CompactAVLTree::iterator class.
+--------------------------------------------------------
+*/
+
+/*
+-------------------------------------------------
+Begin implementations for the CompactAVLTree class.
+-------------------------------------------------
+*/
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::CompactAVLTree() :
+    nodes_(NULL),
+    size_(0),
+    capacity_(0),
+    root_(NIL)
+{
+
+}
+
+template<class Key, class Value>
+CompactAVLTree<Key, Value>::~CompactAVLTree()
+{
+    clear();
+    ::operator delete(nodes_);
+}
+
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::empty() const
+{
+    return root_ == NIL;
+}
+
+template<class Key, class Value>
+std::size_t CompactAVLTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+/**
+* Destroys every node but keeps the array for reuse.
+*/
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::clear()
+{
+    for (uint32_t i = 0; i < size_; i++) {
+        nodes_[i].~NodeType();
+    }
+    size_ = 0;
+    root_ = NIL;
+}
+
+/**
+* Grows the node array to hold at least n nodes without reallocating. The
+* nodes are moved, not copied, into the new array.
+*/
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::reserve(std::size_t n)
+{
+    if (n <= capacity_) return;
+    if (n > NIL) throw std::length_error("CompactAVLTree is limited to 2^30 - 1 nodes");
+
+    NodeType* bigger = static_cast<NodeType*>(::operator new(n * sizeof(NodeType)));
+    for (uint32_t i = 0; i < size_; i++) {
+        new (&bigger[i]) NodeType(std::move(nodes_[i]));
+        nodes_[i].~NodeType();
+    }
+    ::operator delete(nodes_);
+    nodes_ = bigger;
+    capacity_ = (uint32_t)n;
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator
+CompactAVLTree<Key, Value>::begin() const
+{
+    uint32_t curr = root_;
+    if (curr != NIL) {
+        while (node(curr).getLeft() != NIL) curr = node(curr).getLeft();
+    }
+    return iterator(this, curr);
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator
+CompactAVLTree<Key, Value>::end() const
+{
+    return iterator(this, NIL);
+}
+
+template<class Key, class Value>
+typename CompactAVLTree<Key, Value>::iterator
+CompactAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(this, internalFind(key));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& CompactAVLTree<Key, Value>::operator[](const Key& key)
+{
+    uint32_t curr = internalFind(key);
+    if(curr == NIL) throw std::out_of_range("Invalid key");
+    return node(curr).getValue();
+}
+template<class Key, class Value>
+Value const & CompactAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    uint32_t curr = internalFind(key);
+    if(curr == NIL) throw std::out_of_range("Invalid key");
+    return node(curr).getValue();
+}
+
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::internalFind(const Key& key) const
+{
+    uint32_t curr = root_;
+    while (curr != NIL) {
+        const NodeType& n = node(curr);
+        if (key == n.getKey()) {
+            return curr;
+        }
+        curr = (key < n.getKey()) ? n.getLeft() : n.getRight();
+    }
+    return NIL;
+}
+
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::successor(uint32_t current) const
+{
+    uint32_t right = node(current).getRight();
+
+    // walk up ancestor chain
+    if (right == NIL) {
+        uint32_t parent = node(current).getParent();
+        while (parent != NIL && current == node(parent).getRight()) {
+            current = parent;
+            parent = node(current).getParent();
+        }
+        return parent;
+    }
+
+    // walk down subtree
+    current = right;
+    while (node(current).getLeft() != NIL) current = node(current).getLeft();
+    return current;
+}
+
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::predecessor(uint32_t current) const
+{
+    uint32_t left = node(current).getLeft();
+
+    // walk up ancestor chain
+    if (left == NIL) {
+        uint32_t parent = node(current).getParent();
+        while (parent != NIL && current == node(parent).getLeft()) {
+            current = parent;
+            parent = node(current).getParent();
+        }
+        return parent;
+    }
+
+    // walk down subtree
+    current = left;
+    while (node(current).getRight() != NIL) current = node(current).getRight();
+    return current;
+}
+
+/**
+* Appends a node to the array, growing it geometrically. Growth stops at
+* the NIL node limit rather than overshooting it, so reserve only throws
+* once the array really is full.
+*/
+template<class Key, class Value>
+uint32_t CompactAVLTree<Key, Value>::newNode(const Key& key, const Value& value, uint32_t parent)
+{
+    if (size_ == capacity_) {
+        std::size_t grown = capacity_ ? std::min((std::size_t)capacity_ * 2, (std::size_t)NIL) : 16;
+        reserve(std::max(grown, (std::size_t)size_ + 1));
+    }
+    new (&nodes_[size_]) NodeType(key, value, parent);
+    return size_++;
+}
+
+/**
+* Points parent (or the root, if parent is NIL) at newChild instead of oldChild.
+*/
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild)
+{
+    if (parent == NIL) {
+        root_ = newChild;
+    }
+    else if (node(parent).getLeft() == oldChild) {
+        node(parent).setLeft(newChild);
+    }
+    else {
+        node(parent).setRight(newChild);
+    }
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::rotateLeft(uint32_t x)
+{
+    uint32_t p = node(x).getParent();
+    uint32_t y = node(x).getRight();
+    uint32_t b = node(y).getLeft();
+
+    replaceChild(p, x, y);
+    node(y).setParent(p);
+    node(y).setLeft(x);
+    node(x).setParent(y);
+    node(x).setRight(b);
+    if (b != NIL) node(b).setParent(x);
+}
+
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::rotateRight(uint32_t z)
+{
+    uint32_t p = node(z).getParent();
+    uint32_t y = node(z).getLeft();
+    uint32_t c = node(y).getRight();
+
+    replaceChild(p, z, y);
+    node(y).setParent(p);
+    node(y).setRight(z);
+    node(z).setParent(y);
+    node(z).setLeft(c);
+    if (c != NIL) node(c).setParent(z);
+}
+
+/*
+ * Recall: If key is already in the tree, you should
+ * overwrite the current value with the updated value.
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    const Key& key = keyValuePair.first;
+    const Value& value = keyValuePair.second;
+
+    if (empty()) {
+        root_ = newNode(key, value, NIL);
+        return;
+    }
+
+    // walk the tree
+    uint32_t curr = root_;
+    while (true) {
+        if (key == node(curr).getKey()) {
+            node(curr).setValue(value);
+            return;
+        }
+        int8_t side = (key < node(curr).getKey()) ? -1 : 1;
+        uint32_t next = (side == -1) ? node(curr).getLeft() : node(curr).getRight();
+        if (next == NIL) {
+            uint32_t n = newNode(key, value, curr);
+            if (side == -1) node(curr).setLeft(n);
+            else node(curr).setRight(n);
+            insertFix(curr, side);
+            return;
+        }
+        curr = next;
+    }
+}
+
+/**
+* Retraces after the subtree on the given side (-1 left, +1 right) of p
+* grew by one level.
+*/
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::insertFix(uint32_t p, int8_t side)
+{
+    while (p != NIL) {
+        int8_t balance = node(p).getBalance() + side;
+
+        // case 1: b(p) = 0, the height of p did not change
+        if (balance == 0) {
+            node(p).setBalance(0);
+            return;
+        }
+        // case 2: b(p) = 1 or -1, p grew, keep going up
+        if (balance == side) {
+            node(p).setBalance(balance);
+            uint32_t g = node(p).getParent();
+            if (g != NIL) side = (node(g).getLeft() == p) ? -1 : 1;
+            p = g;
+            continue;
+        }
+        // case 3: b(p) = 2 or -2, rotate and stop
+        uint32_t c = (side == -1) ? node(p).getLeft() : node(p).getRight();
+        if (node(c).getBalance() == side) { // zig-zig
+            if (side == -1) rotateRight(p);
+            else rotateLeft(p);
+            node(p).setBalance(0);
+            node(c).setBalance(0);
+        }
+        else { // zig-zag
+            uint32_t g = (side == -1) ? node(c).getRight() : node(c).getLeft();
+            int8_t gb = node(g).getBalance();
+            if (side == -1) {
+                rotateLeft(c);
+                rotateRight(p);
+            }
+            else {
+                rotateRight(c);
+                rotateLeft(p);
+            }
+            node(p).setBalance(gb == side ? -side : 0);
+            node(c).setBalance(gb == -side ? side : 0);
+            node(g).setBalance(0);
+        }
+        return;
+    }
+}
+
+/*
+ * Nodes with two children are replaced by their predecessor, as in AVLTree.
+ */
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::remove(const Key& key)
+{
+    uint32_t curr = internalFind(key);
+    if (curr == NIL) return;
+
+    uint32_t fixFrom;
+    int8_t fixSide;
+
+    if (node(curr).getLeft() != NIL && node(curr).getRight() != NIL) {
+        // unlink the predecessor (it has no right child) and put it in curr's place
+        uint32_t pred = predecessor(curr);
+        uint32_t predParent = node(pred).getParent();
+        uint32_t predLeft = node(pred).getLeft();
+
+        if (predParent == curr) {
+            fixFrom = pred;
+            fixSide = -1;
+        }
+        else {
+            node(predParent).setRight(predLeft);
+            if (predLeft != NIL) node(predLeft).setParent(predParent);
+            node(pred).setLeft(node(curr).getLeft());
+            node(node(pred).getLeft()).setParent(pred);
+            fixFrom = predParent;
+            fixSide = 1;
+        }
+        uint32_t parent = node(curr).getParent();
+        replaceChild(parent, curr, pred);
+        node(pred).setParent(parent);
+        node(pred).setRight(node(curr).getRight());
+        node(node(pred).getRight()).setParent(pred);
+        node(pred).setBalance(node(curr).getBalance());
+    }
+    else {
+        uint32_t child = (node(curr).getLeft() != NIL) ? node(curr).getLeft() : node(curr).getRight();
+        uint32_t parent = node(curr).getParent();
+        fixFrom = parent;
+        fixSide = (parent != NIL && node(parent).getLeft() == curr) ? -1 : 1;
+        replaceChild(parent, curr, child);
+        if (child != NIL) node(child).setParent(parent);
+    }
+
+    removeFix(fixFrom, fixSide);
+
+    // keep the array dense: move the last node into the hole
+    uint32_t last = size_ - 1;
+    nodes_[curr].~NodeType();
+    if (curr != last) {
+        relocate(last, curr);
+        nodes_[last].~NodeType();
+    }
+    size_--;
+}
+
+/**
+* Retraces after the subtree on the given side (-1 left, +1 right) of p
+* shrank by one level.
+*/
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::removeFix(uint32_t p, int8_t side)
+{
+    while (p != NIL) {
+        int8_t balance = node(p).getBalance() - side;
+        uint32_t top = p;
+
+        // case 1: p was even, its height is unchanged
+        if (balance == -side) {
+            node(p).setBalance(balance);
+            return;
+        }
+        // case 2: p is now even and one level shorter
+        if (balance == 0) {
+            node(p).setBalance(0);
+        }
+        // case 3: p is off by two, rotate towards the shrunken side
+        else {
+            int8_t dir = -side;
+            uint32_t c = (dir == -1) ? node(p).getLeft() : node(p).getRight();
+            int8_t cb = node(c).getBalance();
+            if (cb == dir || cb == 0) { // zig-zig
+                if (dir == -1) rotateRight(p);
+                else rotateLeft(p);
+                if (cb == 0) {
+                    node(p).setBalance(dir);
+                    node(c).setBalance(-dir);
+                    return; // height unchanged
+                }
+                node(p).setBalance(0);
+                node(c).setBalance(0);
+                top = c;
+            }
+            else { // zig-zag
+                uint32_t g = (dir == -1) ? node(c).getRight() : node(c).getLeft();
+                int8_t gb = node(g).getBalance();
+                if (dir == -1) {
+                    rotateLeft(c);
+                    rotateRight(p);
+                }
+                else {
+                    rotateRight(c);
+                    rotateLeft(p);
+                }
+                node(p).setBalance(gb == dir ? -dir : 0);
+                node(c).setBalance(gb == -dir ? dir : 0);
+                node(g).setBalance(0);
+                top = g;
+            }
+        }
+
+        // the subtree rooted at top shrank, so its parent needs fixing too
+        p = node(top).getParent();
+        if (p != NIL) side = (node(p).getLeft() == top) ? -1 : 1;
+    }
+}
+
+/**
+* Moves the node at index from into the (unused) slot to, and repoints its
+* parent and children at the new index.
+*/
+template<class Key, class Value>
+void CompactAVLTree<Key, Value>::relocate(uint32_t from, uint32_t to)
+{
+    new (&nodes_[to]) NodeType(std::move(nodes_[from]));
+    NodeType& n = node(to);
+    replaceChild(n.getParent(), from, to);
+    if (n.getLeft() != NIL) node(n.getLeft()).setParent(to);
+    if (n.getRight() != NIL) node(n.getRight()).setParent(to);
+}
+
+/**
+ * Return true iff the tree is balanced.
+ */
+template<class Key, class Value>
+bool CompactAVLTree<Key, Value>::isBalanced() const
+{
+    return isBalancedHelper(root_) != -1;
+}
+
+template<class Key, class Value>
+int CompactAVLTree<Key, Value>::isBalancedHelper(uint32_t root) const
+{
+    if (root == NIL) return 0;
+
+    int leftTree = isBalancedHelper(node(root).getLeft());
+    int rightTree = isBalancedHelper(node(root).getRight());
+    if (leftTree == -1 || rightTree == -1) return -1;
+
+    if (std::abs(leftTree - rightTree) > 1) return -1;
+    return std::max(leftTree, rightTree) + 1;
+}
+
+/*
+-----------------------------------------------
+End implementations for the CompactAVLTree class.
+-----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,144 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <cstdlib>
+#include "concurrent-avl.h"
+
+using namespace std;
+
+// Stress test for ConcurrentAVLMap.
+// Run with: ./concurrent-avl-test [readers] [writers] [ops per writer]
+//
+// Keys below STABLE are inserted up front and never removed, so readers must
+// always find them. Each writer owns its own slice of the keys above that and
+// inserts/removes them at random, mirroring the changes in a std::map. Every
+// key always maps to valueFor(key), so any torn or stale read shows up as a
+// wrong value. At the end the map must hold exactly the stable keys plus
+// every writer's mirror, and still be balanced.
+//
+// Before that, a reader calls find() inside read() while a writer is queued
+// behind the outer read, which deadlocks unless the shared side of the lock
+// is reentrant.
+
+static const int STABLE = 10000;
+static const int SLICE = 5000;
+
+static int valueFor(int key)
+{
+    return key * 3 + 1;
+}
+
+// true if the nested read finished while a writer was waiting
+static bool nestedReadWithWriterWaiting()
+{
+    ConcurrentAVLMap<int, int> shared;
+    shared.insert(make_pair(1, valueFor(1)));
+    atomic<bool> reading(false);
+    thread writer;
+    auto nested = async(launch::async, [&]() {
+        return shared.read([&](const ConcurrentAVLMap<int, int>::Tree&) {
+            reading = true;
+            // give the writer time to raise its flag and start waiting
+            this_thread::sleep_for(chrono::milliseconds(100));
+            int value;
+            return shared.find(1, value) && value == valueFor(1);
+        });
+    });
+    while (!reading.load()) this_thread::yield();
+    writer = thread([&]() { shared.insert(make_pair(2, valueFor(2))); });
+
+    if (nested.wait_for(chrono::seconds(10)) != future_status::ready) {
+        cout << "FAILED: nested read deadlocked behind a waiting writer" << endl;
+        _Exit(1);
+    }
+    bool found = nested.get();
+    writer.join();
+    return found && shared.contains(2);
+}
+
+int main(int argc, char* argv[])
+{
+    int readers = (argc > 1) ? atoi(argv[1]) : 4;
+    int writers = (argc > 2) ? atoi(argv[2]) : 2;
+    int ops = (argc > 3) ? atoi(argv[3]) : 200000;
+
+    bool nestedOk = nestedReadWithWriterWaiting();
+    cout << "Nested read with a writer waiting: " << boolalpha << nestedOk << endl;
+
+    ConcurrentAVLMap<int, int> shared;
+    for (int k = 0; k < STABLE; k++) {
+        shared.insert(make_pair(k, valueFor(k)));
+    }
+
+    atomic<bool> done(false);
+    atomic<long> failures(0), reads(0);
+    vector< map<int, int> > mirrors(writers);
+    vector<thread> threads;
+
+    for (int w = 0; w < writers; w++) {
+        threads.push_back(thread([&, w]() {
+            unsigned seed = 1000 + w;
+            int base = STABLE + w * SLICE;
+            for (int i = 0; i < ops; i++) {
+                int key = base + rand_r(&seed) % SLICE;
+                if (rand_r(&seed) % 2) {
+                    shared.insert(make_pair(key, valueFor(key)));
+                    mirrors[w][key] = valueFor(key);
+                }
+                else {
+                    shared.remove(key);
+                    mirrors[w].erase(key);
+                }
+            }
+        }));
+    }
+
+    for (int r = 0; r < readers; r++) {
+        threads.push_back(thread([&, r]() {
+            unsigned seed = 2000 + r;
+            long n = 0;
+            int range = STABLE + writers * SLICE;
+            while (!done.load()) {
+                int key = rand_r(&seed) % range;
+                int value;
+                bool found = shared.find(key, value);
+                if ((key < STABLE && !found) || (found && value != valueFor(key))) {
+                    failures++;
+                }
+                n++;
+            }
+            reads += n;
+        }));
+    }
+
+    for (int w = 0; w < writers; w++) {
+        threads[w].join();
+    }
+    done = true;
+    for (size_t t = writers; t < threads.size(); t++) {
+        threads[t].join();
+    }
+
+    // the final contents must match the mirrors exactly
+    map<int, int> expected;
+    for (int k = 0; k < STABLE; k++) expected[k] = valueFor(k);
+    for (int w = 0; w < writers; w++) {
+        expected.insert(mirrors[w].begin(), mirrors[w].end());
+    }
+    bool same = shared.read([&](const ConcurrentAVLMap<int, int>::Tree& tree) {
+        map<int, int>::const_iterator e = expected.begin();
+        for (ConcurrentAVLMap<int, int>::Tree::const_iterator it = tree.cbegin(); it != tree.cend(); ++it, ++e) {
+            if (e == expected.end() || e->first != it->first || e->second != it->second) return false;
+        }
+        return e == expected.end() && tree.verify();
+    });
+
+    cout << readers << " readers, " << writers << " writers, " << reads.load() << " reads" << endl;
+    cout << "Read failures: " << failures.load() << endl;
+    cout << "Final contents match: " << boolalpha << same << endl;
+    return (failures.load() == 0 && same && nestedOk) ? 0 : 1;
+}
@@ -0,0 +1,280 @@
+#ifndef CONCURRENT_AVL_H
+#define CONCURRENT_AVL_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* A reader-writer lock built for many readers and few writers.
+*
+* Each reader only touches a counter in its own slot (one cache line per
+* slot), so readers on different cores never contend with each other; a
+* writer raises a flag, then waits for every slot to drain. Readers that
+* see the flag step back and wait for the writer, so writers are not starved.
+* Writers are serialized by a plain mutex.
+*
+* The shared side is reentrant: a thread that already reads can read again
+* (e.g. call find() inside read()) without waiting behind a writer that is
+* itself waiting for that first read to end. The exclusive side is not, and
+* a thread holding it must not take the shared side either.
+*
+* The member names follow the standard Lockable/SharedLockable requirements,
+* so std::lock_guard works for the exclusive side.
+*/
+class ReaderWriterLock
+{
+public:
+    ReaderWriterLock();
+
+    void lock();
+    void unlock();
+    void lock_shared();
+    void unlock_shared();
+
+private:
+    ReaderWriterLock(const ReaderWriterLock&);
+    ReaderWriterLock& operator=(const ReaderWriterLock&);
+
+    static const std::size_t SLOTS = 64;
+    static const std::size_t CACHE_LINE = 64;
+
+    struct Slot {
+        std::atomic<int> readers;
+        char pad[CACHE_LINE - sizeof(std::atomic<int>)];
+    };
+
+    static std::size_t slotIndex();
+    int& sharedDepth();
+
+    Slot slots_[SLOTS];
+    std::atomic<bool> writer_;
+    std::mutex writeMutex_;
+};
+
+inline ReaderWriterLock::ReaderWriterLock() :
+    writer_(false)
+{
+    for (std::size_t i = 0; i < SLOTS; i++) {
+        slots_[i].readers.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Threads are given slots round-robin the first time they read, so up to
+* SLOTS concurrent readers each get a counter of their own.
+*/
+inline std::size_t ReaderWriterLock::slotIndex()
+{
+    static std::atomic<std::size_t> nextSlot(0);
+    static thread_local std::size_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % SLOTS;
+    return slot;
+}
+
+/**
+* How many shared holds the calling thread has on this lock. Slots can be
+* shared by several threads, so their counters cannot tell. Each thread
+* keeps a short list with an entry per lock it has read; entries that drop
+* back to zero are reused.
+*/
+inline int& ReaderWriterLock::sharedDepth()
+{
+    struct Hold {
+        const ReaderWriterLock* lock;
+        int depth;
+    };
+    static thread_local std::vector<Hold> holds;
+    Hold* unused = NULL;
+    for (std::size_t i = 0; i < holds.size(); i++) {
+        if (holds[i].lock == this) return holds[i].depth;
+        if (holds[i].depth == 0 && unused == NULL) unused = &holds[i];
+    }
+    if (unused == NULL) {
+        holds.push_back(Hold());
+        unused = &holds.back();
+    }
+    unused->lock = this;
+    unused->depth = 0;
+    return unused->depth;
+}
+
+inline void ReaderWriterLock::lock_shared()
+{
+    int& depth = sharedDepth();
+    std::atomic<int>& readers = slots_[slotIndex()].readers;
+    if (depth > 0) {
+        // already counted, so any writer is still waiting for this thread
+        readers.fetch_add(1, std::memory_order_relaxed);
+        depth++;
+        return;
+    }
+    while (true) {
+        // announce first, then check: a writer that raised its flag before
+        // this point will either be seen here or will see our count
+        readers.fetch_add(1, std::memory_order_seq_cst);
+        if (!writer_.load(std::memory_order_seq_cst)) break;
+        readers.fetch_sub(1, std::memory_order_release);
+        while (writer_.load(std::memory_order_relaxed)) {
+            std::this_thread::yield();
+        }
+    }
+    depth = 1;
+}
+
+inline void ReaderWriterLock::unlock_shared()
+{
+    sharedDepth()--;
+    slots_[slotIndex()].readers.fetch_sub(1, std::memory_order_release);
+}
+
+inline void ReaderWriterLock::lock()
+{
+    writeMutex_.lock();
+    writer_.store(true, std::memory_order_seq_cst);
+    for (std::size_t i = 0; i < SLOTS; i++) {
+        while (slots_[i].readers.load(std::memory_order_seq_cst) != 0) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+inline void ReaderWriterLock::unlock()
+{
+    writer_.store(false, std::memory_order_release);
+    writeMutex_.unlock();
+}
+
+
+/**
+* An AVLTree that can be shared between threads. Lookups run in parallel
+* under the shared side of a ReaderWriterLock; insert and remove take it
+* exclusively. Nothing hands out iterators or references into the tree,
+* since they would outlive the lock: find() copies the value out, and
+* read()/write() run a function on the tree while the lock is held, for
+* scans and batch updates.
+*/
+template <class Key, class Value, template <typename> class Alloc = NodePool, class Augment = NoAugment>
+class ConcurrentAVLMap
+{
+public:
+    typedef AVLTree<Key, Value, Alloc, Augment> Tree;
+
+    ConcurrentAVLMap();
+
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    bool empty() const;
+    void insert(const std::pair<const Key, Value>& new_item);
+    void remove(const Key& key);
+    void clear();
+
+    // Runs f(const Tree&) under the shared lock, and returns what f returns.
+    template<typename F>
+    auto read(F f) const -> decltype(f(std::declval<const Tree&>()));
+    // Runs f(Tree&) under the exclusive lock, and returns what f returns.
+    template<typename F>
+    auto write(F f) -> decltype(f(std::declval<Tree&>()));
+
+private:
+    ConcurrentAVLMap(const ConcurrentAVLMap&);
+    ConcurrentAVLMap& operator=(const ConcurrentAVLMap&);
+
+    // holds the shared side of the lock for the lifetime of a scope
+    struct SharedGuard {
+        SharedGuard(ReaderWriterLock& lock) : lock_(lock) { lock_.lock_shared(); }
+        ~SharedGuard() { lock_.unlock_shared(); }
+        ReaderWriterLock& lock_;
+    };
+
+    Tree tree_;
+    mutable ReaderWriterLock lock_;
+};
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the ConcurrentAVLMap class.
+  -----------------------------------------------------
+*/
+
+template<class Key, class Value, template <typename> class Alloc, class Augment>
+ConcurrentAVLMap<Key, Value, Alloc, Augment>::ConcurrentAVLMap()
+{
+
+}
+
+/**
+* Copies the value for key into value and returns true, or returns false
+* if key is not in the map.
+*/
+template<class Key, class Value, template <typename> class Alloc, class Augment>
+bool ConcurrentAVLMap<Key, Value, Alloc, Augment>::find(const Key& key, Value& value) const
+{
+    SharedGuard guard(lock_);
+    typename Tree::iterator it = tree_.find(key);
+    if (it == tree_.end()) return false;
+    value = it->second;
+    return true;
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Augment>
+bool ConcurrentAVLMap<Key, Value, Alloc, Augment>::contains(const Key& key) const
+{
+    SharedGuard guard(lock_);
+    return tree_.find(key) != tree_.end();
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Augment>
+bool ConcurrentAVLMap<Key, Value, Alloc, Augment>::empty() const
+{
+    SharedGuard guard(lock_);
+    return tree_.empty();
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Augment>
+void ConcurrentAVLMap<Key, Value, Alloc, Augment>::insert(const std::pair<const Key, Value>& new_item)
+{
+    std::lock_guard<ReaderWriterLock> guard(lock_);
+    tree_.insert(new_item);
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Augment>
+void ConcurrentAVLMap<Key, Value, Alloc, Augment>::remove(const Key& key)
+{
+    std::lock_guard<ReaderWriterLock> guard(lock_);
+    tree_.remove(key);
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Augment>
+void ConcurrentAVLMap<Key, Value, Alloc, Augment>::clear()
+{
+    std::lock_guard<ReaderWriterLock> guard(lock_);
+    tree_.clear();
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Augment>
+template<typename F>
+auto ConcurrentAVLMap<Key, Value, Alloc, Augment>::read(F f) const -> decltype(f(std::declval<const Tree&>()))
+{
+    SharedGuard guard(lock_);
+    return f(tree_);
+}
+
+template<class Key, class Value, template <typename> class Alloc, class Augment>
+template<typename F>
+auto ConcurrentAVLMap<Key, Value, Alloc, Augment>::write(F f) -> decltype(f(std::declval<Tree&>()))
+{
+    std::lock_guard<ReaderWriterLock> guard(lock_);
+    return f(tree_);
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the ConcurrentAVLMap class.
+  ---------------------------------------------------
+*/
+
+#endif
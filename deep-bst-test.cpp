@@ -0,0 +1,138 @@
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include <cstdlib>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+// Stress test for walks over very deep trees.
+// Run with: ./deep-bst-test [depth] [avl keys]
+//
+// Builds degenerate BSTs (a right spine, a left spine and a zig-zag path)
+// that are depth nodes deep, and checks that isBalanced(), iteration,
+// clear() and the destructor get through them without running out of call
+// stack. The nodes come from new/delete, so clear() really walks the tree
+// instead of dropping a pool. Then sorted inserts and removes in an AVLTree
+// drive insertFix and removeFix up long paths, and sorted inserts into a
+// plain tree with auto-rebalancing on must stay within its depth bound.
+
+typedef BinarySearchTree<int, int, NewDeleteAllocator> Tree;
+
+// Links each new node straight below the last one, so building a path of n
+// nodes takes O(n) instead of the O(n^2) of inserting sorted keys.
+class PathTree : public Tree
+{
+public:
+    // dirs(i) picks the side node i + 1 hangs off node i: -1 left, 1 right
+    template<typename Dirs>
+    void buildPath(int n, Dirs dirs)
+    {
+        this->clear();
+        Node<int, int>* tail = NULL;
+        int lo = 0, hi = n;
+        for (int i = 0; i < n; i++) {
+            // keep the keys a valid search path: going left takes the top
+            // of the remaining range, going right the bottom
+            int dir = (i == 0) ? 0 : dirs(i - 1);
+            int nextDir = (i + 1 < n) ? dirs(i) : 1;
+            int key = (nextDir < 0) ? --hi : lo++;
+            Node<int, int>* node = this->createNode(key, i, tail);
+            this->linkLeaf(tail, dir, node);
+            tail = node;
+        }
+    }
+
+    // the depth of the deepest node, counted along the parent pointers
+    int maxDepth() const
+    {
+        int deepest = 0;
+        for (Node<int, int>* n = this->getSmallestNode(); n != NULL; n = Tree::successor(n)) {
+            int d = 0;
+            for (Node<int, int>* p = n->getParent(); p != NULL; p = p->getParent()) d++;
+            if (d > deepest) deepest = d;
+        }
+        return deepest;
+    }
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+template<typename T>
+static int countNodes(const T& t)
+{
+    int count = 0;
+    for (typename T::iterator it = t.begin(); it != t.end(); ++it) count++;
+    return count;
+}
+
+static int right(int) { return 1; }
+static int left(int) { return -1; }
+static int zigzag(int i) { return (i % 2) ? -1 : 1; }
+
+int main(int argc, char* argv[])
+{
+    int depth = (argc > 1) ? atoi(argv[1]) : 10000000;
+    int avlKeys = (argc > 2) ? atoi(argv[2]) : 1000000;
+
+    int (*shapes[])(int) = { right, left, zigzag };
+    const char* names[] = { "right spine", "left spine", "zig-zag" };
+    for (int s = 0; s < 3; s++) {
+        PathTree t;
+        t.buildPath(depth, shapes[s]);
+        cout << names[s] << ", " << depth << " deep" << endl;
+        check(t.isBalanced() == (depth <= 2), "isBalanced on a path");
+        check(countNodes(t) == depth, "iteration on a path");
+        check(t.find(depth / 2) != t.end(), "find on a path");
+        if (s < 2) {
+            t.clear();
+            check(t.empty() && t.begin() == t.end(), "clear on a path");
+        }
+        // the zig-zag one is left for the destructor
+    }
+
+    // sorted keys make insertFix walk the whole right spine of the tree
+    AVLTree<int, int> avl;
+    for (int k = 0; k < avlKeys; k++) avl.insert(make_pair(k, k));
+    check(avl.verify(), "AVL after sorted inserts");
+    for (int k = avlKeys - 1; k >= 0; k -= 2) avl.remove(k);
+    check(avl.verify(), "AVL after removes");
+    check(countNodes(avl) == avlKeys / 2, "AVL size after removes");
+    cout << "AVL, " << avlKeys << " sorted inserts" << endl;
+
+    // c must be 0 or greater than 1: at 1 a complete tree breaks the bound
+    double bad[] = { 1, 0.5, -1, NAN };
+    for (int i = 0; i < 4; i++) {
+        PathTree t;
+        bool threw = false;
+        try {
+            t.setAutoRebalance(bad[i]);
+        }
+        catch (const invalid_argument&) {
+            threw = true;
+        }
+        check(threw, "setAutoRebalance rejects c <= 1");
+    }
+    double factors[] = { 1.01, 1.2, 2 };
+    for (int i = 0; i < 3; i++) {
+        PathTree t;
+        t.setAutoRebalance(factors[i]);
+        int keys = avlKeys / 10;
+        for (int k = 0; k < keys; k++) t.insert(make_pair(k, k));
+        check(countNodes(t) == keys, "auto-rebalanced size");
+        check(t.maxDepth() <= factors[i] * log2((double)keys), "sorted inserts stay within c * log2(n)");
+        cout << "auto-rebalance c = " << factors[i] << ", " << keys << " sorted inserts, depth " << t.maxDepth() << endl;
+    }
+
+    cout << "Failures: " << failures << endl;
+    return failures ? 1 : 0;
+}
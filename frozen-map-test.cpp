@@ -0,0 +1,152 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <string>
+#include <random>
+#include <functional>
+#include <stdexcept>
+#include <cstdlib>
+#include "avlbst.h"
+#include "frozen-map.h"
+
+using namespace std;
+
+// Test for FrozenMap and AVLTree::freeze().
+// Run with: ./frozen-map-test [rounds]
+//
+// Freezes random trees of many sizes (so the van Emde Boas layout is built
+// at every shape of recursion) and checks find, lower_bound, upper_bound and
+// operator[] against a copy of the tree taken before freezing, for every key
+// in it and every gap and end around them. Values count their copies, since
+// freeze moves them out of the tree.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+struct Counted
+{
+    static long copies;
+    string s;
+
+    Counted() {}
+    explicit Counted(const string& str) : s(str) {}
+    Counted(const Counted& other) : s(other.s) { copies++; }
+    Counted(Counted&& other) : s(std::move(other.s)) {}
+    Counted& operator=(const Counted& other) { s = other.s; copies++; return *this; }
+    Counted& operator=(Counted&& other) { s = std::move(other.s); return *this; }
+};
+
+long Counted::copies = 0;
+
+// the trees' print() needs this to instantiate
+static ostream& operator<<(ostream& os, const Counted& c)
+{
+    return os << c.s;
+}
+
+// true if it points at the same pair as e, or both are at the end
+template<typename Frozen>
+static bool at(const Frozen& f, typename Frozen::iterator it, const map<int, string>& m, map<int, string>::const_iterator e)
+{
+    if (e == m.end()) return it == f.end();
+    return it != f.end() && it->first == e->first && it->second.s == e->second;
+}
+
+static void testLookups(int rounds)
+{
+    mt19937 rng(15);
+    for (int round = 0; round < rounds; round++) {
+        // every size up to 70, then larger ones
+        int n = (round < 70) ? round : (int)(rng() % 5000);
+        int range = 3 * n + 1;
+        AVLTree<int, Counted> t;
+        map<int, string> m;
+        while ((int)m.size() < n) {
+            int key = (int)(rng() % range);
+            string value = "value " + to_string(key) + " of a string too long for SSO";
+            t.insert(make_pair(key, Counted(value)));
+            m[key] = value;
+        }
+
+        long copiesBefore = Counted::copies;
+        FrozenMap<int, Counted> f = t.freeze();
+        check(Counted::copies == copiesBefore, "freeze moves the values");
+        check(t.empty() && t.begin() == t.end(), "freeze empties the tree");
+        check(f.size() == m.size() && f.empty() == m.empty(), "size");
+
+        map<int, string>::const_iterator e = m.begin();
+        for (FrozenMap<int, Counted>::iterator it = f.begin(); it != f.end(); ++it, ++e) {
+            check(e != m.end() && it->first == e->first && it->second.s == e->second, "iteration");
+        }
+        for (int key = -2; key < range + 2; key++) {
+            check(at(f, f.find(key), m, m.find(key)), "find");
+            check(at(f, f.lower_bound(key), m, m.lower_bound(key)), "lower_bound");
+            check(at(f, f.upper_bound(key), m, m.upper_bound(key)), "upper_bound");
+            if (m.count(key)) {
+                check(f[key].s == m[key], "operator[]");
+            }
+            else {
+                bool threw = false;
+                try {
+                    f[key];
+                }
+                catch (const out_of_range&) {
+                    threw = true;
+                }
+                check(threw, "operator[] of a missing key throws out_of_range");
+            }
+        }
+    }
+    cout << rounds << " rounds of lookups" << endl;
+}
+
+static void testConstruction()
+{
+    // from a plain sorted vector, and in a custom order
+    vector< pair<int, int> > sorted;
+    for (int k = 0; k < 100; k++) sorted.push_back(make_pair(k * 2, k));
+    FrozenMap<int, int> f(sorted.begin(), sorted.end());
+    check(f.size() == 100 && f.find(50)->second == 25 && f.find(51) == f.end(), "built from a vector");
+
+    vector< pair<int, int> > descending(sorted.rbegin(), sorted.rend());
+    FrozenMap<int, int, greater<int> > g(descending.begin(), descending.end());
+    check(g.begin()->first == 198 && g.lower_bound(51)->first == 50 && g.upper_bound(50)->first == 48,
+          "greater<int> order");
+
+    FrozenMap<int, int> empty;
+    check(empty.empty() && empty.begin() == empty.end() && empty.find(0) == empty.end(), "empty map");
+
+    // keys out of order or repeated, at the start, middle and end
+    int bad[][4] = { { 2, 1, 3, 4 }, { 1, 2, 2, 3 }, { 1, 2, 3, 3 }, { 1, 3, 2, 4 } };
+    for (int i = 0; i < 4; i++) {
+        vector< pair<int, int> > items;
+        for (int k = 0; k < 4; k++) items.push_back(make_pair(bad[i][k], k));
+        bool threw = false;
+        try {
+            FrozenMap<int, int> f(items.begin(), items.end());
+        }
+        catch (const invalid_argument&) {
+            threw = true;
+        }
+        check(threw, "keys that are not strictly increasing throw invalid_argument");
+    }
+    cout << "construction" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 200;
+
+    testLookups(rounds);
+    testConstruction();
+
+    cout << "Failures: " << failures << endl;
+    return failures ? 1 : 0;
+}
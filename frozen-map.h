@@ -0,0 +1,297 @@
+#ifndef FROZEN_MAP_H
+#define FROZEN_MAP_H
+
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+/**
+* An immutable map for data that is built once and then only queried.
+*
+* The pairs sit in one sorted array, so iteration is a linear scan. Searches
+* go through a separate index: a balanced search tree over the keys, stored
+* in van Emde Boas order. That order lays the tree out recursively: the top
+* half of its levels first, then each subtree hanging below them, each laid
+* out the same way. Any subtree of height about log2(B) is then contiguous,
+* for every block size B at once, so a search costs O(log_B n) cache line
+* and page misses instead of one per level, without tuning for any one
+* cache. Each index node holds its key, its children's positions and its
+* pair's position in the sorted array.
+*
+* Build one with AVLTree::freeze(), or from any range sorted by strictly
+* increasing key. At most 2^32 - 2 pairs. Compare orders the keys, as in
+* BinarySearchTree.
+*/
+template <typename Key, typename Value, class Compare = std::less<Key> >
+class FrozenMap
+{
+public:
+    typedef std::pair<const Key, Value> value_type;
+    typedef typename std::vector<value_type>::const_iterator iterator;
+
+    FrozenMap();
+    template<typename ForwardIt>
+    FrozenMap(ForwardIt first, ForwardIt last);
+
+    bool empty() const;
+    std::size_t size() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    static const uint32_t NIL = 0xFFFFFFFF;
+
+    static bool keyLess(const Key& a, const Key& b) { return Compare()(a, b); }
+
+    struct IndexNode {
+        Key key;
+        uint32_t left;      // positions in index_, or NIL
+        uint32_t right;
+        uint32_t rank;      // position of the pair in items_
+    };
+
+    // a subtree of the (implicit) balanced tree over items_[lo, hi)
+    struct Range {
+        uint32_t lo;
+        uint32_t hi;
+        uint32_t root() const { return lo + (hi - lo) / 2; }
+    };
+
+    static int heightOf(uint32_t n);
+    void layout(Range r, int height, std::vector<uint32_t>& position);
+    void collectAtDepth(Range r, int depth, std::vector<Range>& out) const;
+    const IndexNode* lowerBoundNode(const Key& key) const;
+    uint32_t upperBoundRank(const Key& key) const;
+
+    std::vector<value_type> items_;
+    std::vector<IndexNode> index_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the FrozenMap class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+FrozenMap<Key, Value, Compare>::FrozenMap()
+{
+
+}
+
+/**
+* Copies the pairs in [first, last), which must be sorted by strictly
+* increasing key, and builds the index over them in O(n log log n). From
+* std::move_iterators the values are moved instead. Throws
+* std::invalid_argument if the keys are not strictly increasing.
+*/
+template<class Key, class Value, class Compare>
+template<typename ForwardIt>
+FrozenMap<Key, Value, Compare>::FrozenMap(ForwardIt first, ForwardIt last)
+{
+    items_.reserve(std::distance(first, last));
+    for (ForwardIt it = first; it != last; ++it) {
+        items_.push_back(*it);
+        std::size_t n = items_.size();
+        if (n > 1 && !keyLess(items_[n - 2].first, items_[n - 1].first)) {
+            throw std::invalid_argument("FrozenMap: keys must be strictly increasing");
+        }
+    }
+    if (items_.size() >= NIL) {
+        throw std::length_error("FrozenMap: too many pairs");
+    }
+    if (items_.empty()) return;
+
+    // lay the nodes out, remembering where each rank went
+    uint32_t n = (uint32_t)items_.size();
+    std::vector<uint32_t> position(n);
+    index_.reserve(n);
+    Range all = { 0, n };
+    layout(all, heightOf(n), position);
+
+    // then link them: the children of the node for [lo, hi) are the roots
+    // of [lo, root) and [root + 1, hi)
+    std::vector<Range> stack(1, all);
+    while (!stack.empty()) {
+        Range r = stack.back();
+        stack.pop_back();
+        uint32_t root = r.root();
+        IndexNode& node = index_[position[root]];
+        Range left = { r.lo, root }, right = { root + 1, r.hi };
+        node.left = (left.lo < left.hi) ? position[left.root()] : NIL;
+        node.right = (right.lo < right.hi) ? position[right.root()] : NIL;
+        if (left.lo < left.hi) stack.push_back(left);
+        if (right.lo < right.hi) stack.push_back(right);
+    }
+}
+
+/**
+* The height of the balanced tree over n pairs, ceil(log2(n + 1)).
+*/
+template<class Key, class Value, class Compare>
+int FrozenMap<Key, Value, Compare>::heightOf(uint32_t n)
+{
+    int height = 0;
+    for (uint64_t full = 0; full < n; full = full * 2 + 1) height++;
+    return height;
+}
+
+/**
+* Appends the top height levels of the subtree r to index_ in van Emde Boas
+* order: the top half of those levels, then every subtree below them, left
+* to right. position[rank] records where each node went.
+*/
+template<class Key, class Value, class Compare>
+void FrozenMap<Key, Value, Compare>::layout(Range r, int height, std::vector<uint32_t>& position)
+{
+    if (r.lo >= r.hi || height <= 0) return;
+    if (height == 1) {
+        uint32_t root = r.root();
+        IndexNode node = { items_[root].first, NIL, NIL, root };
+        position[root] = (uint32_t)index_.size();
+        index_.push_back(node);
+        return;
+    }
+
+    int top = height / 2;
+    layout(r, top, position);
+
+    std::vector<Range> bottoms;
+    collectAtDepth(r, top, bottoms);
+    for (std::size_t i = 0; i < bottoms.size(); i++) {
+        layout(bottoms[i], height - top, position);
+    }
+}
+
+/**
+* Collects the non-empty subtrees of r whose roots are depth levels below
+* r's root, left to right.
+*/
+template<class Key, class Value, class Compare>
+void FrozenMap<Key, Value, Compare>::collectAtDepth(Range r, int depth, std::vector<Range>& out) const
+{
+    if (r.lo >= r.hi) return;
+    if (depth == 0) {
+        out.push_back(r);
+        return;
+    }
+    uint32_t root = r.root();
+    Range left = { r.lo, root }, right = { root + 1, r.hi };
+    collectAtDepth(left, depth - 1, out);
+    collectAtDepth(right, depth - 1, out);
+}
+
+template<class Key, class Value, class Compare>
+bool FrozenMap<Key, Value, Compare>::empty() const
+{
+    return items_.empty();
+}
+
+template<class Key, class Value, class Compare>
+std::size_t FrozenMap<Key, Value, Compare>::size() const
+{
+    return items_.size();
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenMap<Key, Value, Compare>::iterator FrozenMap<Key, Value, Compare>::begin() const
+{
+    return items_.begin();
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenMap<Key, Value, Compare>::iterator FrozenMap<Key, Value, Compare>::end() const
+{
+    return items_.end();
+}
+
+/**
+* The index node of the first key not less than key (NULL if none), in one
+* descent of the index. The root is at position 0. Returning the node lets
+* find() check the key without touching the pair array.
+*/
+template<class Key, class Value, class Compare>
+const typename FrozenMap<Key, Value, Compare>::IndexNode* FrozenMap<Key, Value, Compare>::lowerBoundNode(const Key& key) const
+{
+    const IndexNode* result = NULL;
+    uint32_t i = index_.empty() ? NIL : 0;
+    while (i != NIL) {
+        const IndexNode& node = index_[i];
+        if (keyLess(node.key, key)) {
+            i = node.right;
+        }
+        else {
+            result = &node;
+            i = node.left;
+        }
+    }
+    return result;
+}
+
+template<class Key, class Value, class Compare>
+uint32_t FrozenMap<Key, Value, Compare>::upperBoundRank(const Key& key) const
+{
+    uint32_t result = (uint32_t)items_.size();
+    uint32_t i = index_.empty() ? NIL : 0;
+    while (i != NIL) {
+        const IndexNode& node = index_[i];
+        if (keyLess(key, node.key)) {
+            result = node.rank;
+            i = node.left;
+        }
+        else {
+            i = node.right;
+        }
+    }
+    return result;
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenMap<Key, Value, Compare>::iterator FrozenMap<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    const IndexNode* node = lowerBoundNode(key);
+    return node ? items_.begin() + node->rank : items_.end();
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenMap<Key, Value, Compare>::iterator FrozenMap<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return items_.begin() + upperBoundRank(key);
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenMap<Key, Value, Compare>::iterator FrozenMap<Key, Value, Compare>::find(const Key& key) const
+{
+    const IndexNode* node = lowerBoundNode(key);
+    if (node == NULL || keyLess(key, node->key)) return end();
+    return items_.begin() + node->rank;
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value const & FrozenMap<Key, Value, Compare>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/*
+  -------------------------------------------
+  End implementations for the FrozenMap class.
+  -------------------------------------------
+*/
+
+#endif
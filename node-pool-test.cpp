@@ -0,0 +1,169 @@
+#include <iostream>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include "node-pool.h"
+
+using namespace std;
+
+// Test for the node allocation policies.
+// Run with: ./node-pool-test
+//
+// operator new and delete are replaced with counting versions, so the test
+// sees every slab NodePool asks for: freed nodes must be handed out again
+// before any fresh slab space, slabs must double from 32 nodes up to 4096
+// and then stay there, and releaseAll() must give every slab back at once,
+// unless another pool may still hold nodes from them. NewDeleteAllocator
+// must do one allocation per node and decline releaseAll().
+
+static int failures = 0;
+
+struct Node {
+    char payload[40];
+};
+
+// blocks big enough to be slabs, at least 32 nodes; the pool's own
+// bookkeeping and the test's vectors stay below that
+static const size_t SLAB_MIN = 32 * sizeof(Node);
+static long slabs = 0;
+static size_t lastSlab = 0;
+static void* live[256];
+static int liveCount = 0;
+
+void* operator new(size_t size)
+{
+    void* p = malloc(size ? size : 1);
+    if (p == NULL) throw bad_alloc();
+    if (size >= SLAB_MIN && liveCount < 256) {
+        slabs++;
+        lastSlab = size;
+        live[liveCount++] = p;
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    for (int i = 0; i < liveCount; i++) {
+        if (live[i] == p) {
+            live[i] = live[--liveCount];
+            break;
+        }
+    }
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+static void testReuse()
+{
+    NodePool<Node> pool;
+    long before = slabs;
+    Node* first = pool.allocate();
+    check(slabs == before + 1 && lastSlab == 32 * sizeof(Node), "the first slab holds 32 nodes");
+
+    vector<Node*> nodes(1, first);
+    for (int i = 1; i < 32; i++) nodes.push_back(pool.allocate());
+    check(slabs == before + 1, "32 nodes fit in the first slab");
+    for (int i = 1; i < 32; i++) {
+        check(nodes[i] == (Node*)((char*)nodes[i - 1] + sizeof(Node)), "nodes are carved out of the slab in order");
+    }
+
+    // the second slab has room to spare, but freed nodes come first, last
+    // freed first
+    nodes.push_back(pool.allocate());
+    check(slabs == before + 2 && lastSlab == 64 * sizeof(Node), "the second slab holds 64 nodes");
+    pool.deallocate(nodes[5]);
+    pool.deallocate(nodes[20]);
+    check(pool.allocate() == nodes[20] && pool.allocate() == nodes[5], "freed nodes are reused first");
+    Node* fresh = pool.allocate();
+    check(fresh == (Node*)((char*)nodes[32] + sizeof(Node)), "then the slab tail");
+    check(slabs == before + 2, "reuse allocates nothing");
+    cout << "reuse" << endl;
+}
+
+static void testGrowth()
+{
+    NodePool<Node> pool;
+    long before = slabs;
+    size_t expect = 32, total = 0;
+    bool doubling = true;
+    for (int slab = 0; slab < 12; slab++) {
+        // the first node past a full slab starts the next one
+        long seen = slabs;
+        pool.allocate();
+        doubling = doubling && slabs == seen + 1 && lastSlab == expect * sizeof(Node);
+        for (size_t i = 1; i < expect; i++) pool.allocate();
+        total += expect;
+        if (expect < 4096) expect *= 2;
+    }
+    check(doubling, "slabs double from 32 nodes and stop at 4096");
+    check(slabs == before + 12, "one allocation per slab");
+    cout << "growth, " << total << " nodes" << endl;
+}
+
+static void testRelease()
+{
+    int before = liveCount;
+    {
+        NodePool<Node> pool;
+        for (int i = 0; i < 32 + 64 + 1; i++) pool.allocate();
+        check(liveCount == before + 3, "three slabs for 97 nodes");
+        check(pool.releaseAll() && liveCount == before, "releaseAll frees every slab");
+        long seen = slabs;
+        pool.allocate();
+        check(slabs == seen + 1 && lastSlab == 32 * sizeof(Node), "after releaseAll slabs start small again");
+        check(pool.releaseAll(), "releaseAll again");
+    }
+    check(NodePool<Node>().releaseAll(), "releaseAll of an unused pool");
+
+    // once a pool has adopted another's nodes, the other may not drop its
+    // slabs, since they may still be in use; with the adopter gone it may
+    NodePool<Node> other;
+    Node* n = other.allocate();
+    {
+        NodePool<Node> adopter;
+        adopter.allocate();
+        adopter.adopt(other);
+        check(!other.releaseAll(), "releaseAll declines while another pool may hold the nodes");
+        adopter.deallocate(n);
+    }
+    check(other.releaseAll(), "releaseAll once the adopting pool is gone");
+
+    // nodes too big to miss in the counts
+    struct Big {
+        char payload[SLAB_MIN];
+    };
+    NewDeleteAllocator<Big> plain;
+    long seen = slabs;
+    Big* x = plain.allocate();
+    Big* y = plain.allocate();
+    check(slabs == seen + 2 && lastSlab == sizeof(Big), "NewDeleteAllocator allocates each node");
+    check(!plain.releaseAll(), "NewDeleteAllocator declines releaseAll");
+    int held = liveCount;
+    plain.deallocate(x);
+    plain.deallocate(y);
+    check(liveCount == held - 2, "NewDeleteAllocator frees each node");
+    cout << "release" << endl;
+}
+
+int main()
+{
+    testReuse();
+    testGrowth();
+    testRelease();
+
+    cout << "Failures: " << failures << endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,238 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <memory>
+
+/**
+* Allocation policies for search tree nodes.
+*
+* A policy is a class template taking the node type. The trees only hand
+* it raw storage requests; constructing and destroying the node in that
+* storage is the tree's job. Every policy provides:
+*
+*   T*   allocate();           // uninitialized storage for one T
+*   void deallocate(T* p);     // give back storage from allocate()
+*   bool releaseAll();         // drop every outstanding node at once,
+*                              // without destructors; false if unsupported
+*   void adopt(Policy& other); // let this policy hold and free the nodes
+*                              // other handed out, so nodes can move between
+*                              // trees (split/join)
+*/
+
+/**
+* The plain policy: one operator new / operator delete per node.
+*/
+template <typename T>
+class NewDeleteAllocator
+{
+public:
+    T* allocate();
+    void deallocate(T* p);
+    bool releaseAll();
+    void adopt(NewDeleteAllocator& other);
+};
+
+template<typename T>
+T* NewDeleteAllocator<T>::allocate()
+{
+    return static_cast<T*>(::operator new(sizeof(T)));
+}
+
+template<typename T>
+void NewDeleteAllocator<T>::deallocate(T* p)
+{
+    ::operator delete(p);
+}
+
+/**
+* Nodes are not tracked, so they have to be freed one at a time.
+*/
+template<typename T>
+bool NewDeleteAllocator<T>::releaseAll()
+{
+    return false;
+}
+
+/**
+* Every node came from the global heap, so any allocator can free it.
+*/
+template<typename T>
+void NewDeleteAllocator<T>::adopt(NewDeleteAllocator<T>& other)
+{
+
+}
+
+
+/**
+* A slab/free-list node pool. Nodes are carved out of contiguous slabs,
+* freed nodes go on an intrusive free list and are handed out again before
+* any fresh slab space, and releaseAll() returns every slab in one go.
+* Slabs start small and double up to MAX_SLAB_NODES so small trees stay
+* small.
+*
+* The slabs live in an arena, which stays alive as long as any pool that
+* may hold nodes from it. adopt() is how a pool comes to hold another's
+* nodes (split/join hand whole subtrees between trees): the adopting pool
+* keeps the other's arena alive, and frees those nodes onto its own free
+* list. Free lists and slab tails are never shared, so pools that have
+* adopted one another can be used on different threads afterwards. While
+* another pool keeps its arena, releaseAll() declines and the tree frees
+* its nodes one at a time.
+*
+* Pools are not copyable, and a single pool is not thread-safe.
+*/
+template <typename T>
+class NodePool
+{
+public:
+    NodePool();
+
+    T* allocate();
+    void deallocate(T* p);
+    bool releaseAll();
+    void adopt(NodePool& other);
+
+private:
+    NodePool(const NodePool&);
+    NodePool& operator=(const NodePool&);
+
+    // freed nodes are reused as links in the free list
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    static const std::size_t MIN_SLAB_NODES = 32;
+    static const std::size_t MAX_SLAB_NODES = 4096;
+    static const std::size_t SLOT_SIZE =
+        sizeof(T) < sizeof(FreeSlot) ? sizeof(FreeSlot) : sizeof(T);
+
+    // only the pool that made an arena adds slabs to it; the others just
+    // keep it alive
+    struct Arena {
+        ~Arena();
+        std::vector<void*> slabs;
+    };
+
+    void grow();
+    void keep(const std::shared_ptr<Arena>& arena);
+
+    std::shared_ptr<Arena> arena_;
+    std::vector<std::shared_ptr<Arena> > kept_;  // other pools' arenas this one may hold nodes from
+    FreeSlot* freeList_;
+    char* next_;        // unused tail of the newest slab
+    char* end_;
+    std::size_t slabNodes_;
+};
+
+template<typename T>
+NodePool<T>::Arena::~Arena()
+{
+    for (std::size_t i = 0; i < slabs.size(); i++) {
+        ::operator delete(slabs[i]);
+    }
+}
+
+template<typename T>
+NodePool<T>::NodePool() :
+    freeList_(NULL),
+    next_(NULL),
+    end_(NULL),
+    slabNodes_(MIN_SLAB_NODES)
+{
+
+}
+
+/**
+* Adds a slab to this pool's arena, creating the arena on first use.
+*/
+template<typename T>
+void NodePool<T>::grow()
+{
+    if (!arena_) {
+        arena_.reset(new Arena());
+    }
+    arena_->slabs.reserve(arena_->slabs.size() + 1);
+    std::size_t bytes = slabNodes_ * SLOT_SIZE;
+    char* slab = static_cast<char*>(::operator new(bytes));
+    arena_->slabs.push_back(slab);
+    next_ = slab;
+    end_ = slab + bytes;
+    if (slabNodes_ < MAX_SLAB_NODES) slabNodes_ *= 2;
+}
+
+template<typename T>
+T* NodePool<T>::allocate()
+{
+    if (freeList_) {
+        FreeSlot* slot = freeList_;
+        freeList_ = slot->next;
+        return reinterpret_cast<T*>(slot);
+    }
+    if (next_ == end_) {
+        grow();
+    }
+    T* p = reinterpret_cast<T*>(next_);
+    next_ += SLOT_SIZE;
+    return p;
+}
+
+/**
+* p may come from this pool or from any pool it has adopted.
+*/
+template<typename T>
+void NodePool<T>::deallocate(T* p)
+{
+    FreeSlot* slot = reinterpret_cast<FreeSlot*>(p);
+    slot->next = freeList_;
+    freeList_ = slot;
+}
+
+/**
+* Frees every slab, unless another pool has adopted this one and so may
+* still hold nodes from them, in which case false is returned. Any node
+* still handed out by this pool, adopted ones included, becomes invalid, so
+* the caller must already be done with all of them.
+*/
+template<typename T>
+bool NodePool<T>::releaseAll()
+{
+    if (arena_ && arena_.use_count() != 1) return false;
+    // dropping the last reference frees the slabs; the arenas of adopted
+    // pools go once their other holders are done with them too
+    arena_.reset();
+    kept_.clear();
+    freeList_ = NULL;
+    next_ = end_ = NULL;
+    slabNodes_ = MIN_SLAB_NODES;
+    return true;
+}
+
+/**
+* Lets this pool hold and free the nodes other has handed out, including
+* those other adopted in turn. Their slabs stay allocated as long as this
+* pool, or until its releaseAll().
+*/
+template<typename T>
+void NodePool<T>::adopt(NodePool<T>& other)
+{
+    if (&other == this) return;
+    if (other.arena_) keep(other.arena_);
+    for (std::size_t i = 0; i < other.kept_.size(); i++) {
+        keep(other.kept_[i]);
+    }
+}
+
+template<typename T>
+void NodePool<T>::keep(const std::shared_ptr<Arena>& arena)
+{
+    if (arena == arena_) return;
+    for (std::size_t i = 0; i < kept_.size(); i++) {
+        if (kept_[i] == arena) return;
+    }
+    kept_.push_back(arena);
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <random>
+#include <functional>
+#include <thread>
+#include <cstdlib>
+#include "persistent-avl.h"
+
+using namespace std;
+
+// Randomized test for PersistentAVLTree and its snapshots.
+// Run with: ./persistent-avl-test [ops]
+//
+// Random inserts and removes go into the tree and into a std::map, and a
+// snapshot is kept (along with a copy of the map) every few hundred steps.
+// Every snapshot must keep matching its own copy and stay balanced however
+// the tree changes after it. Values count their live instances, so once the
+// tree and every snapshot are gone, no node may be left: the reference
+// counts have to reclaim exactly the nodes no version uses.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+struct Tracked
+{
+    static long live;
+    int v;
+
+    Tracked() : v(0) { live++; }
+    Tracked(int value) : v(value) { live++; }
+    Tracked(const Tracked& other) : v(other.v) { live++; }
+    Tracked& operator=(const Tracked& other) { v = other.v; return *this; }
+    ~Tracked() { live--; }
+};
+
+long Tracked::live = 0;
+
+typedef PersistentAVLTree<int, Tracked> Tree;
+
+template<typename Snapshot, typename Map>
+static bool same(const Snapshot& s, const Map& m)
+{
+    typename Map::const_iterator e = m.begin();
+    for (typename Snapshot::iterator it = s.begin(); it != s.end(); ++it, ++e) {
+        if (e == m.end() || e->first != it->first || e->second != it->second.v) return false;
+    }
+    return e == m.end() && s.size() == m.size();
+}
+
+// find, lower_bound and operator[] on a few keys in and out of the snapshot
+template<typename Snapshot, typename Map>
+static bool lookups(const Snapshot& s, const Map& m, mt19937& rng, int range)
+{
+    for (int probe = 0; probe < 20; probe++) {
+        int key = (int)(rng() % range);
+        typename Map::const_iterator e = m.find(key);
+        typename Snapshot::iterator it = s.find(key);
+        if ((e == m.end()) != (it == s.end())) return false;
+        if (e != m.end() && (it->second.v != e->second || s[key].v != e->second)) return false;
+        typename Map::const_iterator lb = m.lower_bound(key);
+        it = s.lower_bound(key);
+        if ((lb == m.end()) != (it == s.end())) return false;
+        if (lb != m.end() && it->first != lb->first) return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int ops = (argc > 1) ? atoi(argv[1]) : 100000;
+    int range = 3000;
+    mt19937 rng(13);
+
+    {
+        Tree t;
+        map<int, int> m;
+        vector<Tree::Snapshot> snapshots;
+        vector< map<int, int> > copies;
+        for (int i = 0; i < ops; i++) {
+            int key = (int)(rng() % range);
+            if (rng() % 3) {
+                t.insert(make_pair(key, Tracked(i)));
+                m[key] = i;
+            }
+            else {
+                t.remove(key);
+                m.erase(key);
+            }
+            if (i % 500 == 0) {
+                snapshots.push_back(t.snapshot());
+                copies.push_back(m);
+            }
+            // drop an old snapshot now and then, so reclamation runs while
+            // other versions still share its nodes
+            if (i % 1700 == 0 && snapshots.size() > 3) {
+                size_t drop = rng() % snapshots.size();
+                snapshots.erase(snapshots.begin() + drop);
+                copies.erase(copies.begin() + drop);
+            }
+            if (i % 997 == 0) {
+                check(same(t, m) && t.isBalanced(), "tree contents and balance");
+                for (size_t s = 0; s < snapshots.size(); s++) {
+                    check(same(snapshots[s], copies[s]), "snapshot contents");
+                    check(snapshots[s].isBalanced(), "snapshot balance");
+                    check(lookups(snapshots[s], copies[s], rng, range), "snapshot lookups");
+                }
+            }
+        }
+        check(same(t, m) && t.isBalanced() && lookups(t, m, rng, range), "final tree");
+        cout << ops << " random ops, " << snapshots.size() << " snapshots kept" << endl;
+
+        // the versions share nodes: far fewer are alive than their sizes add up to
+        size_t total = t.size();
+        for (size_t s = 0; s < snapshots.size(); s++) total += snapshots[s].size();
+        check((size_t)Tracked::live < total, "snapshots share their nodes");
+
+        // clearing the tree leaves the snapshots intact, and the last one can
+        // go on another thread
+        t.clear();
+        check(t.empty() && t.begin() == t.end(), "clear");
+        for (size_t s = 0; s < snapshots.size(); s++) {
+            check(same(snapshots[s], copies[s]), "snapshot after clear");
+        }
+        thread dropper([&]() { snapshots.clear(); });
+        dropper.join();
+        check(Tracked::live == 0, "every node reclaimed once no version uses it");
+    }
+
+    // with no snapshot outstanding, updates reuse the nodes in place
+    {
+        Tree t;
+        for (int k = 0; k < 1000; k++) t.insert(make_pair(k, Tracked(k)));
+        long before = Tracked::live;
+        for (int k = 0; k < 1000; k++) t.insert(make_pair(k, Tracked(-k)));
+        check(Tracked::live == before, "overwrites without snapshots copy no nodes");
+        Tree::Snapshot s = t.snapshot();
+        t.insert(make_pair(500, Tracked(7)));
+        check(Tracked::live > before && s[500].v == -500 && t[500].v == 7, "a write after a snapshot copies its path");
+    }
+    check(Tracked::live == 0, "nodes reclaimed after overwrites");
+
+    // a custom order
+    PersistentAVLTree<int, Tracked, greater<int> > desc;
+    map<int, int, greater<int> > mdesc;
+    for (int i = 0; i < 2000; i++) {
+        int key = (int)(rng() % range);
+        if (rng() % 4) {
+            desc.insert(make_pair(key, Tracked(i)));
+            mdesc[key] = i;
+        }
+        else {
+            desc.remove(key);
+            mdesc.erase(key);
+        }
+    }
+    check(same(desc, mdesc) && desc.isBalanced(), "descending order");
+    check(lookups(desc, mdesc, rng, range), "descending lookups");
+
+    cout << "Failures: " << failures << endl;
+    return failures ? 1 : 0;
+}
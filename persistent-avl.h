@@ -0,0 +1,732 @@
+#ifndef PERSISTENT_AVL_H
+#define PERSISTENT_AVL_H
+
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+/**
+* A node of a PersistentAVLTree. Nodes are shared between versions of the
+* tree, so there is no parent pointer (a shared subtree has many parents),
+* and each node counts the versions and parent nodes referring to it. It
+* stores its height rather than a balance, since rebalancing works bottom-up
+* on freshly copied nodes without a parent to update.
+*/
+template <typename Key, typename Value>
+class PersistentAVLNode
+{
+public:
+    explicit PersistentAVLNode(const std::pair<const Key, Value>& item);
+    PersistentAVLNode(const PersistentAVLNode<Key, Value>& other);
+
+    const std::pair<const Key, Value>& getItem() const;
+    const Key& getKey() const;
+    const Value& getValue() const;
+    void setValue(const Value& value);
+
+    PersistentAVLNode<Key, Value>* getLeft() const;
+    PersistentAVLNode<Key, Value>* getRight() const;
+    int8_t getHeight() const;
+
+    void setLeft(PersistentAVLNode<Key, Value>* left);
+    void setRight(PersistentAVLNode<Key, Value>* right);
+    void updateHeight();
+
+    // Reference counting. A node with one reference is owned by exactly one
+    // parent (or version) and may be changed in place.
+    void retain();
+    bool release();
+    bool isShared() const;
+
+    static int8_t heightOf(const PersistentAVLNode<Key, Value>* n);
+
+private:
+    PersistentAVLNode<Key, Value>& operator=(const PersistentAVLNode<Key, Value>&);
+
+    std::pair<const Key, Value> item_;
+    PersistentAVLNode<Key, Value>* left_;
+    PersistentAVLNode<Key, Value>* right_;
+    int8_t height_;
+    std::atomic<std::size_t> refs_;
+};
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the PersistentAVLNode class.
+  -----------------------------------------------------
+*/
+
+template<class Key, class Value>
+PersistentAVLNode<Key, Value>::PersistentAVLNode(const std::pair<const Key, Value>& item) :
+    item_(item),
+    left_(NULL),
+    right_(NULL),
+    height_(1),
+    refs_(1)
+{
+
+}
+
+/**
+* A copy for path copying: same item and children (which gain a reference),
+* but a reference count of its own.
+*/
+template<class Key, class Value>
+PersistentAVLNode<Key, Value>::PersistentAVLNode(const PersistentAVLNode<Key, Value>& other) :
+    item_(other.item_),
+    left_(other.left_),
+    right_(other.right_),
+    height_(other.height_),
+    refs_(1)
+{
+    if (left_) left_->retain();
+    if (right_) right_->retain();
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& PersistentAVLNode<Key, Value>::getItem() const
+{
+    return item_;
+}
+
+template<class Key, class Value>
+const Key& PersistentAVLNode<Key, Value>::getKey() const
+{
+    return item_.first;
+}
+
+template<class Key, class Value>
+const Value& PersistentAVLNode<Key, Value>::getValue() const
+{
+    return item_.second;
+}
+
+template<class Key, class Value>
+void PersistentAVLNode<Key, Value>::setValue(const Value& value)
+{
+    item_.second = value;
+}
+
+template<class Key, class Value>
+PersistentAVLNode<Key, Value>* PersistentAVLNode<Key, Value>::getLeft() const
+{
+    return left_;
+}
+
+template<class Key, class Value>
+PersistentAVLNode<Key, Value>* PersistentAVLNode<Key, Value>::getRight() const
+{
+    return right_;
+}
+
+template<class Key, class Value>
+int8_t PersistentAVLNode<Key, Value>::getHeight() const
+{
+    return height_;
+}
+
+template<class Key, class Value>
+void PersistentAVLNode<Key, Value>::setLeft(PersistentAVLNode<Key, Value>* left)
+{
+    left_ = left;
+}
+
+template<class Key, class Value>
+void PersistentAVLNode<Key, Value>::setRight(PersistentAVLNode<Key, Value>* right)
+{
+    right_ = right;
+}
+
+/**
+* Recomputes the height from the children's.
+*/
+template<class Key, class Value>
+void PersistentAVLNode<Key, Value>::updateHeight()
+{
+    height_ = (int8_t)(std::max(heightOf(left_), heightOf(right_)) + 1);
+}
+
+template<class Key, class Value>
+void PersistentAVLNode<Key, Value>::retain()
+{
+    refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+* Drops a reference and returns true if it was the last one, in which case
+* the caller must delete the node.
+*/
+template<class Key, class Value>
+bool PersistentAVLNode<Key, Value>::release()
+{
+    return refs_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+
+template<class Key, class Value>
+bool PersistentAVLNode<Key, Value>::isShared() const
+{
+    return refs_.load(std::memory_order_acquire) != 1;
+}
+
+template<class Key, class Value>
+int8_t PersistentAVLNode<Key, Value>::heightOf(const PersistentAVLNode<Key, Value>* n)
+{
+    return n ? n->height_ : 0;
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the PersistentAVLNode class.
+  ---------------------------------------------------
+*/
+
+/**
+* An immutable version of a PersistentAVLTree. Copying one, and taking one
+* with PersistentAVLTree::snapshot(), is O(1): it only adds a reference to
+* the root. Nodes are reclaimed once no version refers to them, and reference
+* counts are atomic, so snapshots can be read and dropped on other threads
+* while the tree they came from keeps changing.
+*/
+template <typename Key, typename Value, class Compare = std::less<Key> >
+class PersistentAVLSnapshot
+{
+public:
+    PersistentAVLSnapshot();
+    PersistentAVLSnapshot(const PersistentAVLSnapshot<Key, Value, Compare>& other);
+    PersistentAVLSnapshot<Key, Value, Compare>& operator=(const PersistentAVLSnapshot<Key, Value, Compare>& other);
+    ~PersistentAVLSnapshot();
+
+    bool empty() const;
+    std::size_t size() const;
+    bool isBalanced() const;
+
+    /**
+    * A read-only iterator over the items in key order. There are no parent
+    * pointers to climb, so it keeps the path of ancestors it still has to
+    * visit on a stack.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++(); // pre-increment
+
+    protected:
+        friend class PersistentAVLSnapshot<Key, Value, Compare>;
+        void pushLeftSpine(PersistentAVLNode<Key, Value>* n);
+        // the current node on top, under it the ancestors whose left subtree we are in
+        std::vector<PersistentAVLNode<Key, Value>*> path_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    typedef PersistentAVLNode<Key, Value> NodeType;
+
+    static void release(NodeType* n);
+    static int isBalancedHelper(NodeType* n);
+    static bool keyLess(const Key& a, const Key& b) { return Compare()(a, b); }
+
+    NodeType* root_;
+    std::size_t size_;
+};
+
+/*
+-----------------------------------------------------------------
+Begin implementations for the PersistentAVLSnapshot::iterator class.
+-----------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+PersistentAVLSnapshot<Key, Value, Compare>::iterator::iterator()
+{
+
+}
+
+template<class Key, class Value, class Compare>
+void PersistentAVLSnapshot<Key, Value, Compare>::iterator::pushLeftSpine(PersistentAVLNode<Key, Value>* n)
+{
+    for (; n != NULL; n = n->getLeft()) {
+        path_.push_back(n);
+    }
+}
+
+template<class Key, class Value, class Compare>
+const std::pair<const Key,Value> &
+PersistentAVLSnapshot<Key, Value, Compare>::iterator::operator*() const
+{
+    return path_.back()->getItem();
+}
+
+template<class Key, class Value, class Compare>
+const std::pair<const Key,Value> *
+PersistentAVLSnapshot<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(path_.back()->getItem());
+}
+
+template<class Key, class Value, class Compare>
+bool
+PersistentAVLSnapshot<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    if (path_.empty() || rhs.path_.empty()) return path_.empty() == rhs.path_.empty();
+    return path_.back() == rhs.path_.back();
+}
+
+template<class Key, class Value, class Compare>
+bool
+PersistentAVLSnapshot<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLSnapshot<Key, Value, Compare>::iterator&
+PersistentAVLSnapshot<Key, Value, Compare>::iterator::operator++()
+{
+    PersistentAVLNode<Key, Value>* right = path_.back()->getRight();
+    path_.pop_back();
+    pushLeftSpine(right);
+    return *this;
+}
+
+/*
+---------------------------------------------------------------
+End implementations for the PersistentAVLSnapshot::iterator class.
+---------------------------------------------------------------
+*/
+
+/*
+--------------------------------------------------------
+Begin implementations for the PersistentAVLSnapshot class.
+--------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+PersistentAVLSnapshot<Key, Value, Compare>::PersistentAVLSnapshot() :
+    root_(NULL),
+    size_(0)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLSnapshot<Key, Value, Compare>::PersistentAVLSnapshot(const PersistentAVLSnapshot<Key, Value, Compare>& other) :
+    root_(other.root_),
+    size_(other.size_)
+{
+    if (root_) root_->retain();
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLSnapshot<Key, Value, Compare>& PersistentAVLSnapshot<Key, Value, Compare>::operator=(const PersistentAVLSnapshot<Key, Value, Compare>& other)
+{
+    // retain first, in case other shares our root
+    if (other.root_) other.root_->retain();
+    release(root_);
+    root_ = other.root_;
+    size_ = other.size_;
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLSnapshot<Key, Value, Compare>::~PersistentAVLSnapshot()
+{
+    release(root_);
+}
+
+template<class Key, class Value, class Compare>
+bool PersistentAVLSnapshot<Key, Value, Compare>::empty() const
+{
+    return root_ == NULL;
+}
+
+template<class Key, class Value, class Compare>
+std::size_t PersistentAVLSnapshot<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value, class Compare>
+bool PersistentAVLSnapshot<Key, Value, Compare>::isBalanced() const
+{
+    return isBalancedHelper(root_) != -1;
+}
+
+template<class Key, class Value, class Compare>
+int PersistentAVLSnapshot<Key, Value, Compare>::isBalancedHelper(NodeType* n)
+{
+    if (!n) return 0;
+    int left = isBalancedHelper(n->getLeft());
+    int right = isBalancedHelper(n->getRight());
+    if (left == -1 || right == -1 || std::abs(left - right) > 1) return -1;
+    int height = std::max(left, right) + 1;
+    return (height == n->getHeight()) ? height : -1;
+}
+
+/**
+* Drops a reference to the subtree at n, deleting the nodes (and dropping
+* their references to their children) that no version uses any more.
+* Only the unshared top of a subtree is walked, since a shared node stops
+* the descent.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLSnapshot<Key, Value, Compare>::release(NodeType* n)
+{
+    if (n == NULL || !n->release()) return;
+    release(n->getLeft());
+    release(n->getRight());
+    delete n;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLSnapshot<Key, Value, Compare>::iterator
+PersistentAVLSnapshot<Key, Value, Compare>::begin() const
+{
+    iterator it;
+    it.pushLeftSpine(root_);
+    return it;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLSnapshot<Key, Value, Compare>::iterator
+PersistentAVLSnapshot<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key. The
+* descent leaves exactly the ancestors still to be visited on its stack.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLSnapshot<Key, Value, Compare>::iterator
+PersistentAVLSnapshot<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    iterator it;
+    NodeType* curr = root_;
+    while (curr != NULL) {
+        if (keyLess(curr->getKey(), key)) {
+            curr = curr->getRight();
+        }
+        else {
+            it.path_.push_back(curr);
+            curr = curr->getLeft();
+        }
+    }
+    return it;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLSnapshot<Key, Value, Compare>::iterator
+PersistentAVLSnapshot<Key, Value, Compare>::find(const Key& key) const
+{
+    iterator it = lower_bound(key);
+    if (it != end() && keyLess(key, it->first)) return end();
+    return it;
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value const & PersistentAVLSnapshot<Key, Value, Compare>::operator[](const Key& key) const
+{
+    NodeType* curr = root_;
+    while (curr != NULL) {
+        if (keyLess(key, curr->getKey())) curr = curr->getLeft();
+        else if (keyLess(curr->getKey(), key)) curr = curr->getRight();
+        else return curr->getValue();
+    }
+    throw std::out_of_range("Invalid key");
+}
+
+/*
+------------------------------------------------------
+End implementations for the PersistentAVLSnapshot class.
+------------------------------------------------------
+*/
+
+/**
+* A persistent AVL tree. insert and remove copy only the nodes on the path
+* they change (O(log n) of them) and share every other subtree with earlier
+* versions, so snapshot() is O(1) and a snapshot stays valid and unchanged
+* however the tree is updated afterwards. Nodes that no snapshot refers to
+* are changed in place instead of copied, so with no snapshots outstanding
+* updates allocate no more than an ordinary AVL tree.
+*
+* The tree itself is also a snapshot of its current version, for lookups
+* and iteration. Its iterators are invalidated by updates; a snapshot's are
+* not. Updates must come from one thread at a time.
+*
+* Nodes use plain new/delete rather than a NodePool, since the last
+* snapshot holding a node may be released on any thread.
+*
+* Compare orders the keys, std::less<Key> by default, and is default
+* constructed for every comparison like BinarySearchTree's. A tree and its
+* snapshots always share it, being the same type.
+*/
+template <typename Key, typename Value, class Compare = std::less<Key> >
+class PersistentAVLTree : public PersistentAVLSnapshot<Key, Value, Compare>
+{
+public:
+    typedef PersistentAVLSnapshot<Key, Value, Compare> Snapshot;
+
+    PersistentAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    Snapshot snapshot() const;
+
+protected:
+    typedef PersistentAVLNode<Key, Value> NodeType;
+    using Snapshot::keyLess;
+
+    static NodeType* own(NodeType* n);
+    static NodeType* rotateLeft(NodeType* x);
+    static NodeType* rotateRight(NodeType* z);
+    static NodeType* rebalance(NodeType* n);
+    static NodeType* insertHelper(NodeType* n, const std::pair<const Key, Value>& item, bool& added);
+    static NodeType* removeHelper(NodeType* n, const Key& key, bool& removed);
+    static NodeType* detachMin(NodeType* n, NodeType*& min);
+};
+
+/*
+----------------------------------------------------
+Begin implementations for the PersistentAVLTree class.
+----------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree()
+{
+
+}
+
+/**
+* Returns an immutable handle on the current version, in O(1).
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Snapshot PersistentAVLTree<Key, Value, Compare>::snapshot() const
+{
+    return Snapshot(*this);
+}
+
+/**
+* Inserts the pair, or overwrites the value if the key is already there.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    bool added = false;
+    this->root_ = insertHelper(this->root_, keyValuePair, added);
+    if (added) this->size_++;
+}
+
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    bool removed = false;
+    this->root_ = removeHelper(this->root_, key, removed);
+    if (removed) this->size_--;
+}
+
+/**
+* Drops the current version. Nodes still used by snapshots stay alive.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::clear()
+{
+    Snapshot::release(this->root_);
+    this->root_ = NULL;
+    this->size_ = 0;
+}
+
+/**
+* Takes over the reference to n held by its parent and returns a node that
+* can be changed: n itself if nothing else refers to it, otherwise a copy
+* (and n loses the reference). Since the walk goes top-down through owned
+* nodes, a node with one reference is reachable from this version only.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::NodeType* PersistentAVLTree<Key, Value, Compare>::own(NodeType* n)
+{
+    if (!n->isShared()) return n;
+    NodeType* copy = new NodeType(*n);
+    Snapshot::release(n);
+    return copy;
+}
+
+/**
+* Rotates left at the owned node x and returns the new subtree root. The
+* right child moves up, so it is owned (copied if shared) first.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::NodeType* PersistentAVLTree<Key, Value, Compare>::rotateLeft(NodeType* x)
+{
+    NodeType* y = own(x->getRight());
+    x->setRight(y->getLeft());
+    y->setLeft(x);
+    x->updateHeight();
+    y->updateHeight();
+    return y;
+}
+
+/**
+* Rotates right at the owned node z, see rotateLeft.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::NodeType* PersistentAVLTree<Key, Value, Compare>::rotateRight(NodeType* z)
+{
+    NodeType* y = own(z->getLeft());
+    z->setLeft(y->getRight());
+    y->setRight(z);
+    z->updateHeight();
+    y->updateHeight();
+    return y;
+}
+
+/**
+* Restores the AVL property at the owned node n, whose subtrees are AVL trees
+* differing in height by at most two, and returns the new subtree root.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::NodeType* PersistentAVLTree<Key, Value, Compare>::rebalance(NodeType* n)
+{
+    n->updateHeight();
+    int balance = NodeType::heightOf(n->getRight()) - NodeType::heightOf(n->getLeft());
+    if (balance > 1) {
+        NodeType* right = n->getRight();
+        if (NodeType::heightOf(right->getLeft()) > NodeType::heightOf(right->getRight())) {
+            n->setRight(rotateRight(own(right)));
+        }
+        return rotateLeft(n);
+    }
+    if (balance < -1) {
+        NodeType* left = n->getLeft();
+        if (NodeType::heightOf(left->getRight()) > NodeType::heightOf(left->getLeft())) {
+            n->setLeft(rotateLeft(own(left)));
+        }
+        return rotateRight(n);
+    }
+    return n;
+}
+
+/**
+* Inserts into the subtree at n, taking over the caller's reference to n and
+* returning the new subtree root. Sets added if the key was new.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::NodeType*
+PersistentAVLTree<Key, Value, Compare>::insertHelper(NodeType* n, const std::pair<const Key, Value>& item, bool& added)
+{
+    if (n == NULL) {
+        added = true;
+        return new NodeType(item);
+    }
+    n = own(n);
+    int8_t childHeight;
+    if (keyLess(item.first, n->getKey())) {
+        childHeight = NodeType::heightOf(n->getLeft());
+        n->setLeft(insertHelper(n->getLeft(), item, added));
+        // the child kept its height, so nothing above it changes
+        if (NodeType::heightOf(n->getLeft()) == childHeight) return n;
+    }
+    else if (keyLess(n->getKey(), item.first)) {
+        childHeight = NodeType::heightOf(n->getRight());
+        n->setRight(insertHelper(n->getRight(), item, added));
+        if (NodeType::heightOf(n->getRight()) == childHeight) return n;
+    }
+    else {
+        n->setValue(item.second);
+        return n;
+    }
+    return rebalance(n);
+}
+
+/**
+* Removes key from the subtree at n, taking over the caller's reference to n
+* and returning the new subtree root. Sets removed if the key was there.
+* A missing key still copies the search path if it is shared.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::NodeType*
+PersistentAVLTree<Key, Value, Compare>::removeHelper(NodeType* n, const Key& key, bool& removed)
+{
+    if (n == NULL) return NULL;
+    if (keyLess(key, n->getKey())) {
+        n = own(n);
+        n->setLeft(removeHelper(n->getLeft(), key, removed));
+        return rebalance(n);
+    }
+    if (keyLess(n->getKey(), key)) {
+        n = own(n);
+        n->setRight(removeHelper(n->getRight(), key, removed));
+        return rebalance(n);
+    }
+
+    // found: take references to the children, then drop n
+    removed = true;
+    NodeType* left = n->getLeft();
+    NodeType* right = n->getRight();
+    if (left) left->retain();
+    if (right) right->retain();
+    Snapshot::release(n);
+
+    if (left == NULL) return right;
+    if (right == NULL) return left;
+
+    // the successor takes n's place
+    NodeType* min;
+    right = detachMin(right, min);
+    min->setLeft(left);
+    min->setRight(right);
+    return rebalance(min);
+}
+
+/**
+* Removes the smallest node from the non-empty subtree at n (taking over the
+* caller's reference) into min, owned and with no children, and returns the
+* rest of the subtree.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::NodeType* PersistentAVLTree<Key, Value, Compare>::detachMin(NodeType* n, NodeType*& min)
+{
+    n = own(n);
+    if (n->getLeft() == NULL) {
+        NodeType* right = n->getRight();
+        n->setRight(NULL);
+        min = n;
+        return right;
+    }
+    n->setLeft(detachMin(n->getLeft(), min));
+    return rebalance(n);
+}
+
+/*
+--------------------------------------------------
+End implementations for the PersistentAVLTree class.
+--------------------------------------------------
+*/
+
+#endif
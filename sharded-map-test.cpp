@@ -0,0 +1,145 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include "sharded-map.h"
+
+using namespace std;
+
+// Test for ShardedMap's ordered scans and batches.
+// Run with: ./sharded-map-test [ops]
+//
+// Random updates and batches go into a hash-routed and a range-routed map
+// and into a std::map; forEach and forEachInRange must give back the same
+// pairs in key order. A scan's f then writes to the map it is scanning,
+// and a scan runs while another thread writes, neither of which may
+// deadlock.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+template<typename Map>
+static bool scanMatches(const Map& sharded, const map<int, int>& m, int lo, int hi, bool ranged)
+{
+    vector< pair<int, int> > got, expect;
+    if (ranged) {
+        sharded.forEachInRange(lo, hi, [&](const pair<const int, int>& p) { got.push_back(p); });
+        if (lo <= hi) expect.assign(m.lower_bound(lo), m.upper_bound(hi));
+    }
+    else {
+        sharded.forEach([&](const pair<const int, int>& p) { got.push_back(p); });
+        expect.assign(m.begin(), m.end());
+    }
+    return got == expect;
+}
+
+template<typename Map>
+static void testMap(Map& sharded, int ops, const char* name)
+{
+    mt19937 rng(14);
+    map<int, int> m;
+    int range = 10000;
+    for (int i = 0; i < ops; i++) {
+        int key = (int)(rng() % range);
+        if (rng() % 3) {
+            sharded.insert(make_pair(key, i));
+            m[key] = i;
+        }
+        else {
+            sharded.remove(key);
+            m.erase(key);
+        }
+        if (i % 5000 == 0) {
+            vector< pair<int, int> > batch;
+            for (int k = 0; k < 300; k++) {
+                int bkey = (int)(rng() % range);
+                batch.push_back(make_pair(bkey, -k));
+                m[bkey] = -k;     // the last pair for a key wins
+            }
+            sharded.insertBatch(batch.begin(), batch.end());
+            vector<int> keys;
+            for (int k = 0; k < 300; k++) {
+                int rkey = (int)(rng() % range);
+                keys.push_back(rkey);
+                m.erase(rkey);
+            }
+            sharded.removeBatch(keys.begin(), keys.end());
+        }
+        if (i % 2500 == 0) {
+            check(scanMatches(sharded, m, 0, 0, false), "forEach");
+            int lo = (int)(rng() % (range + 20)) - 10, hi = (int)(rng() % (range + 20)) - 10;
+            check(scanMatches(sharded, m, lo, hi, true), "forEachInRange");
+        }
+    }
+    check(scanMatches(sharded, m, 0, 0, false), "final forEach");
+
+    // findBatch answers in input order
+    vector<int> keys;
+    for (int k = 0; k < 500; k++) keys.push_back((int)(rng() % range));
+    vector< pair<bool, int> > found;
+    sharded.findBatch(keys.begin(), keys.end(), back_inserter(found));
+    bool same = found.size() == keys.size();
+    for (size_t k = 0; same && k < keys.size(); k++) {
+        map<int, int>::iterator e = m.find(keys[k]);
+        same = (e != m.end()) == found[k].first && (e == m.end() || e->second == found[k].second);
+    }
+    check(same, "findBatch");
+
+    // f may write to the map it scans; it sees the pairs from before
+    vector< pair<int, int> > seen;
+    sharded.forEach([&](const pair<const int, int>& p) {
+        seen.push_back(p);
+        sharded.insert(make_pair(p.first + range, p.second));
+        sharded.remove(p.first);
+    });
+    check(seen == vector< pair<int, int> >(m.begin(), m.end()), "scan that writes sees the old pairs");
+    map<int, int> moved;
+    for (map<int, int>::iterator it = m.begin(); it != m.end(); ++it) moved[it->first + range] = it->second;
+    check(scanMatches(sharded, moved, 0, 0, false), "writes made during a scan");
+
+    // scans alongside a writer
+    atomic<bool> done(false);
+    thread writer([&]() {
+        for (int i = 0; i < 20000; i++) sharded.insert(make_pair(i % 1000, i));
+        done = true;
+    });
+    int scans = 0;
+    bool ordered = true;
+    while (!done.load() || scans == 0) {
+        int last = -1;
+        sharded.forEach([&](const pair<const int, int>& p) {
+            if (p.first <= last) ordered = false;
+            last = p.first;
+        });
+        scans++;
+    }
+    writer.join();
+    check(ordered, "scans stay in key order while another thread writes");
+    cout << name << ", " << ops << " ops, " << scans << " scans alongside a writer" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int ops = (argc > 1) ? atoi(argv[1]) : 50000;
+
+    ShardedMap<int, int> hashed(HashShards<int>(8));
+    testMap(hashed, ops, "HashShards");
+
+    vector<int> splits;
+    for (int s = 1; s < 8; s++) splits.push_back(s * 1250);
+    ShardedMap<int, int, RangeShards<int> > ranged((RangeShards<int>(splits)));
+    testMap(ranged, ops, "RangeShards");
+
+    cout << "Failures: " << failures << endl;
+    return failures ? 1 : 0;
+}
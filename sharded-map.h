@@ -0,0 +1,416 @@
+#ifndef SHARDED_MAP_H
+#define SHARDED_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <algorithm>
+#include "concurrent-avl.h"
+
+/**
+* Routing policies for ShardedMap. A router splits the keys between a fixed
+* number of shards:
+*
+*   std::size_t shards() const;
+*   std::size_t shardOf(const Key& key) const;   // in [0, shards())
+*/
+
+/**
+* Spreads keys evenly by hash. The hash is mixed before it is reduced, since
+* std::hash is the identity for integers and strided keys would otherwise
+* pile up in a few shards.
+*/
+template <typename Key, typename Hash = std::hash<Key> >
+class HashShards
+{
+public:
+    explicit HashShards(std::size_t shards);
+
+    std::size_t shards() const;
+    std::size_t shardOf(const Key& key) const;
+
+private:
+    std::size_t shards_;
+    Hash hash_;
+};
+
+template<typename Key, typename Hash>
+HashShards<Key, Hash>::HashShards(std::size_t shards) :
+    shards_(shards)
+{
+    if (shards == 0) throw std::invalid_argument("HashShards: need at least one shard");
+}
+
+template<typename Key, typename Hash>
+std::size_t HashShards<Key, Hash>::shards() const
+{
+    return shards_;
+}
+
+template<typename Key, typename Hash>
+std::size_t HashShards<Key, Hash>::shardOf(const Key& key) const
+{
+    uint64_t h = (uint64_t)hash_(key) * 0x9E3779B97F4A7C15ull;
+    return (std::size_t)((h >> 32) % shards_);
+}
+
+/**
+* Splits the key space at the given points, which must be sorted: shard 0
+* gets the keys below the first point, shard i the keys in
+* [splits[i-1], splits[i]), and the last shard the rest. Keeps each shard a
+* contiguous key range, so a range scan only draws items from the shards the
+* range overlaps.
+*/
+template <typename Key>
+class RangeShards
+{
+public:
+    explicit RangeShards(const std::vector<Key>& splits);
+
+    std::size_t shards() const;
+    std::size_t shardOf(const Key& key) const;
+
+private:
+    std::vector<Key> splits_;
+};
+
+template<typename Key>
+RangeShards<Key>::RangeShards(const std::vector<Key>& splits) :
+    splits_(splits)
+{
+    for (std::size_t i = 1; i < splits_.size(); i++) {
+        if (!(splits_[i - 1] < splits_[i])) {
+            throw std::invalid_argument("RangeShards: split points must be strictly increasing");
+        }
+    }
+}
+
+template<typename Key>
+std::size_t RangeShards<Key>::shards() const
+{
+    return splits_.size() + 1;
+}
+
+template<typename Key>
+std::size_t RangeShards<Key>::shardOf(const Key& key) const
+{
+    return std::upper_bound(splits_.begin(), splits_.end(), key) - splits_.begin();
+}
+
+
+/**
+* A map split across several independent AVL trees (shards), each a
+* ConcurrentAVLMap with its own lock and node pool, so that writers to
+* different shards never wait for each other. Router decides which shard
+* a key lives in (see HashShards and RangeShards).
+*
+* Ordered scans copy each shard's pairs out under that shard's shared lock,
+* one shard at a time, then merge the copies with a k-way merge and no lock
+* held. Batch operations group their keys by shard and take each shard's
+* lock once. Each single-key operation is atomic; a batch or a scan is
+* atomic per shard only.
+*/
+template <class Key, class Value, class Router = HashShards<Key> >
+class ShardedMap
+{
+public:
+    typedef ConcurrentAVLMap<Key, Value> Shard;
+    typedef typename Shard::Tree Tree;
+
+    explicit ShardedMap(const Router& router);
+
+    std::size_t shards() const;
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    bool empty() const;
+    void insert(const std::pair<const Key, Value>& new_item);
+    void remove(const Key& key);
+    void clear();
+
+    // Calls f(pair) on every pair (with key in [lo, hi]) in key order. f
+    // runs on copies with no lock held, so it may use the map, but it sees
+    // the pairs as they were when the scan reached their shard.
+    template<typename F>
+    void forEach(F f) const;
+    template<typename F>
+    void forEachInRange(const Key& lo, const Key& hi, F f) const;
+
+    // Batches of pairs or keys, in any order. For repeated keys in an
+    // insert batch the last pair wins. findBatch writes one
+    // std::pair<bool, Value> (found, value) per key to out, in input order.
+    template<typename ForwardIt>
+    void insertBatch(ForwardIt first, ForwardIt last);
+    template<typename ForwardIt>
+    void removeBatch(ForwardIt first, ForwardIt last);
+    template<typename ForwardIt, typename OutputIt>
+    void findBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+
+    Shard& shard(std::size_t i);
+    const Shard& shard(std::size_t i) const;
+
+protected:
+    typedef typename Tree::iterator TreeIterator;
+    typedef std::vector< std::pair<const Key, Value> > Copy;
+
+    // one shard's place in a k-way merge, ordered so that the smallest
+    // key comes out of a std::priority_queue first
+    struct Cursor {
+        typename Copy::const_iterator it;
+        typename Copy::const_iterator end;
+        bool operator<(const Cursor& rhs) const { return rhs.it->first < it->first; }
+    };
+
+    template<typename F>
+    void scan(const Key* lo, const Key* hi, F& f) const;
+    template<typename F>
+    static void mergeScan(std::vector<Cursor>& cursors, F& f);
+
+    template<typename Item>
+    static bool itemLess(const Item& a, const Item& b) { return a.first < b.first; }
+
+private:
+    ShardedMap(const ShardedMap&);
+    ShardedMap& operator=(const ShardedMap&);
+
+    Router router_;
+    std::vector< std::unique_ptr<Shard> > shards_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the ShardedMap class.
+  -----------------------------------------------
+*/
+
+template<class Key, class Value, class Router>
+ShardedMap<Key, Value, Router>::ShardedMap(const Router& router) :
+    router_(router)
+{
+    for (std::size_t i = 0; i < router_.shards(); i++) {
+        shards_.push_back(std::unique_ptr<Shard>(new Shard()));
+    }
+}
+
+template<class Key, class Value, class Router>
+std::size_t ShardedMap<Key, Value, Router>::shards() const
+{
+    return shards_.size();
+}
+
+template<class Key, class Value, class Router>
+typename ShardedMap<Key, Value, Router>::Shard& ShardedMap<Key, Value, Router>::shard(std::size_t i)
+{
+    return *shards_[i];
+}
+
+template<class Key, class Value, class Router>
+const typename ShardedMap<Key, Value, Router>::Shard& ShardedMap<Key, Value, Router>::shard(std::size_t i) const
+{
+    return *shards_[i];
+}
+
+template<class Key, class Value, class Router>
+bool ShardedMap<Key, Value, Router>::find(const Key& key, Value& value) const
+{
+    return shards_[router_.shardOf(key)]->find(key, value);
+}
+
+template<class Key, class Value, class Router>
+bool ShardedMap<Key, Value, Router>::contains(const Key& key) const
+{
+    return shards_[router_.shardOf(key)]->contains(key);
+}
+
+template<class Key, class Value, class Router>
+bool ShardedMap<Key, Value, Router>::empty() const
+{
+    for (std::size_t i = 0; i < shards_.size(); i++) {
+        if (!shards_[i]->empty()) return false;
+    }
+    return true;
+}
+
+template<class Key, class Value, class Router>
+void ShardedMap<Key, Value, Router>::insert(const std::pair<const Key, Value>& new_item)
+{
+    shards_[router_.shardOf(new_item.first)]->insert(new_item);
+}
+
+template<class Key, class Value, class Router>
+void ShardedMap<Key, Value, Router>::remove(const Key& key)
+{
+    shards_[router_.shardOf(key)]->remove(key);
+}
+
+template<class Key, class Value, class Router>
+void ShardedMap<Key, Value, Router>::clear()
+{
+    for (std::size_t i = 0; i < shards_.size(); i++) {
+        shards_[i]->clear();
+    }
+}
+
+template<class Key, class Value, class Router>
+template<typename F>
+void ShardedMap<Key, Value, Router>::forEach(F f) const
+{
+    scan(NULL, NULL, f);
+}
+
+template<class Key, class Value, class Router>
+template<typename F>
+void ShardedMap<Key, Value, Router>::forEachInRange(const Key& lo, const Key& hi, F f) const
+{
+    if (hi < lo) return;
+    scan(&lo, &hi, f);
+}
+
+/**
+* Copies the pairs of each shard (with keys in [*lo, *hi] when not NULL) out
+* under that shard's shared lock alone, then merges the copies unlocked.
+* Holding one lock at a time keeps writers to the other shards going, and
+* f can do anything with the map, including writing to it.
+*/
+template<class Key, class Value, class Router>
+template<typename F>
+void ShardedMap<Key, Value, Router>::scan(const Key* lo, const Key* hi, F& f) const
+{
+    std::vector<Copy> copies(shards_.size());
+    std::vector<Cursor> cursors;
+    for (std::size_t i = 0; i < shards_.size(); i++) {
+        Copy& copy = copies[i];
+        shards_[i]->read([&](const Tree& tree) {
+            TreeIterator last = hi ? tree.upper_bound(*hi) : tree.end();
+            for (TreeIterator it = lo ? tree.lower_bound(*lo) : tree.begin(); it != last; ++it) {
+                copy.push_back(*it);
+            }
+        });
+        if (!copy.empty()) {
+            Cursor c;
+            c.it = copy.begin();
+            c.end = copy.end();
+            cursors.push_back(c);
+        }
+    }
+    mergeScan(cursors, f);
+}
+
+/**
+* The k-way merge: a heap of the shards' current positions, smallest key on
+* top. Each step takes the top, advances it and pushes it back, for
+* O(log k) per item.
+*/
+template<class Key, class Value, class Router>
+template<typename F>
+void ShardedMap<Key, Value, Router>::mergeScan(std::vector<Cursor>& cursors, F& f)
+{
+    std::priority_queue<Cursor> heap(std::less<Cursor>(), cursors);
+    while (!heap.empty()) {
+        Cursor c = heap.top();
+        heap.pop();
+        f(*c.it);
+        ++c.it;
+        if (c.it != c.end) heap.push(c);
+    }
+}
+
+/**
+* Inserts every pair, grouped by shard: each shard's pairs are sorted and
+* merged in with one AVLTree::insertBatch under one lock.
+*/
+template<class Key, class Value, class Router>
+template<typename ForwardIt>
+void ShardedMap<Key, Value, Router>::insertBatch(ForwardIt first, ForwardIt last)
+{
+    typedef std::pair<Key, Value> Item;
+    std::vector< std::vector<Item> > groups(shards_.size());
+    for (ForwardIt it = first; it != last; ++it) {
+        groups[router_.shardOf(it->first)].push_back(Item(it->first, it->second));
+    }
+
+    for (std::size_t i = 0; i < groups.size(); i++) {
+        std::vector<Item>& group = groups[i];
+        if (group.empty()) continue;
+
+        // stable, so that among repeated keys the last one can be kept
+        std::stable_sort(group.begin(), group.end(), itemLess<Item>);
+        std::size_t kept = 0;
+        for (std::size_t j = 0; j < group.size(); j++) {
+            if (kept > 0 && !(group[kept - 1].first < group[j].first)) group[kept - 1] = group[j];
+            else group[kept++] = group[j];
+        }
+        group.resize(kept);
+
+        shards_[i]->write([&](Tree& tree) { tree.insertBatch(group.begin(), group.end()); });
+    }
+}
+
+/**
+* Removes every key, grouped by shard like insertBatch.
+*/
+template<class Key, class Value, class Router>
+template<typename ForwardIt>
+void ShardedMap<Key, Value, Router>::removeBatch(ForwardIt first, ForwardIt last)
+{
+    std::vector< std::vector<Key> > groups(shards_.size());
+    for (ForwardIt it = first; it != last; ++it) {
+        groups[router_.shardOf(*it)].push_back(*it);
+    }
+
+    for (std::size_t i = 0; i < groups.size(); i++) {
+        std::vector<Key>& group = groups[i];
+        if (group.empty()) continue;
+
+        std::sort(group.begin(), group.end());
+        std::size_t kept = 0;
+        for (std::size_t j = 0; j < group.size(); j++) {
+            if (kept == 0 || group[kept - 1] < group[j]) group[kept++] = group[j];
+        }
+        group.resize(kept);
+
+        shards_[i]->write([&](Tree& tree) { tree.removeBatch(group.begin(), group.end()); });
+    }
+}
+
+/**
+* Looks up every key, taking each shard's shared lock once for all of the
+* keys routed to it.
+*/
+template<class Key, class Value, class Router>
+template<typename ForwardIt, typename OutputIt>
+void ShardedMap<Key, Value, Router>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) const
+{
+    // (shard, input position) for every key
+    std::vector< std::vector<std::size_t> > groups(shards_.size());
+    std::vector<const Key*> keys;
+    for (ForwardIt it = first; it != last; ++it) {
+        groups[router_.shardOf(*it)].push_back(keys.size());
+        keys.push_back(&*it);
+    }
+
+    std::vector< std::pair<bool, Value> > results(keys.size(), std::make_pair(false, Value()));
+    for (std::size_t i = 0; i < groups.size(); i++) {
+        const std::vector<std::size_t>& group = groups[i];
+        if (group.empty()) continue;
+        shards_[i]->read([&](const Tree& tree) {
+            for (std::size_t j = 0; j < group.size(); j++) {
+                TreeIterator found = tree.find(*keys[group[j]]);
+                if (found != tree.end()) results[group[j]] = std::make_pair(true, found->second);
+            }
+        });
+    }
+    std::copy(results.begin(), results.end(), out);
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ShardedMap class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,175 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <string>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include "simd-index.h"
+
+using namespace std;
+
+// Test for SimdIndex, on every key type SimdNodeSearch specializes and on
+// two that take the general version.
+// Run with: ./simd-index-test [rounds]
+//
+// The Makefile builds this twice: simd-index-test with the default flags
+// (SSE2 on x86-64, so uint64_t keys take the general version) and
+// simd-index-test-native with -march=native (AVX2 and SSE4.2 where the CPU
+// has them). Each key type draws from a pool of random keys plus its edge
+// values: the padding value itself (INT_MAX, UINT32_MAX, UINT64_MAX, +inf),
+// unsigned keys with the high bit set, which a sign-flip bug would order
+// wrongly, and for the general version Key(), which is its padding. Random
+// subsets of the pool are indexed, and every key in the pool is looked up
+// against a std::map.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+static void randomKey(mt19937_64& rng, int& key) { key = (int)(uint32_t)rng(); }
+static void randomKey(mt19937_64& rng, uint32_t& key) { key = (uint32_t)rng(); }
+static void randomKey(mt19937_64& rng, uint64_t& key) { key = rng(); }
+static void randomKey(mt19937_64& rng, int64_t& key) { key = (int64_t)(rng() >> (rng() % 64)) - (int64_t)(rng() % 1000); }
+static void randomKey(mt19937_64& rng, double& key) { key = uniform_real_distribution<double>(-1e9, 1e9)(rng); }
+static void randomKey(mt19937_64& rng, string& key)
+{
+    key.assign(rng() % 8, 'a');
+    for (size_t i = 0; i < key.size(); i++) key[i] += (char)(rng() % 4);
+}
+
+template<typename Key>
+static void testKeys(int rounds, const vector<Key>& edges, const char* name)
+{
+    mt19937_64 rng(16);
+    for (int round = 0; round < rounds; round++) {
+        // every size that fills a node part-way, then up to three levels
+        size_t n = (round < 40) ? round : rng() % 6000;
+        vector<Key> pool(edges);
+        while (pool.size() < 2 * n + edges.size()) {
+            Key key;
+            randomKey(rng, key);
+            pool.push_back(key);
+        }
+        sort(pool.begin(), pool.end());
+        pool.erase(unique(pool.begin(), pool.end()), pool.end());
+
+        // the edge values go in about half the time each
+        map<Key, int> m;
+        vector<Key> shuffled(pool);
+        shuffle(shuffled.begin(), shuffled.end(), rng);
+        for (size_t i = 0; i < shuffled.size() && m.size() < n; i++) {
+            m[shuffled[i]] = (int)i;
+        }
+        for (size_t i = 0; i < edges.size(); i++) {
+            if (rng() % 2) m[edges[i]] = -(int)i;
+        }
+
+        SimdIndex<Key, int> built(m.begin(), m.end());
+        SimdIndex<Key, int> copied(built), assigned;
+        assigned = built;
+        SimdIndex<Key, int>* indexes[] = { &built, &copied, &assigned };
+        for (int which = 0; which < 3; which++) {
+            const SimdIndex<Key, int>& index = *indexes[which];
+            check(index.size() == m.size() && equal(index.begin(), index.end(), m.begin()), "contents");
+            for (size_t i = 0; i < pool.size(); i++) {
+                const Key& key = pool[i];
+                typename map<Key, int>::const_iterator lb = m.lower_bound(key);
+                typename SimdIndex<Key, int>::iterator it = index.lower_bound(key);
+                check(lb == m.end() ? it == index.end() : (it != index.end() && it->first == lb->first),
+                      "lower_bound");
+                it = index.find(key);
+                if (m.count(key)) {
+                    check(it != index.end() && it->first == key && it->second == m[key] && index[key] == m[key],
+                          "find of a present key");
+                }
+                else {
+                    check(it == index.end(), "find of an absent key");
+                }
+            }
+        }
+    }
+    cout << rounds << " rounds, " << name
+         << (SimdNodeSearch<Key>::vectorized ? ", vectorized" : ", general version") << endl;
+}
+
+// default-constructed, built from nothing, and copies of both: no storage
+// at all in the first case, only the alignment slack in the second
+template<typename Key>
+static void testEmpty(const Key& key, const char* name)
+{
+    vector< pair<Key, int> > none;
+    SimdIndex<Key, int> unset, built(none.begin(), none.end());
+    SimdIndex<Key, int> copied(unset), copiedBuilt(built), assigned, assignedBuilt;
+    assigned = unset;
+    assignedBuilt = built;
+    SimdIndex<Key, int>* indexes[] = { &unset, &built, &copied, &copiedBuilt, &assigned, &assignedBuilt };
+    for (int which = 0; which < 6; which++) {
+        const SimdIndex<Key, int>& index = *indexes[which];
+        check(index.size() == 0 && index.begin() == index.end(), "an empty index has no pairs");
+        check(index.find(key) == index.end() && index.lower_bound(key) == index.end(), "lookups in an empty index");
+        bool threw = false;
+        try {
+            index[key];
+        }
+        catch (const out_of_range&) {
+            threw = true;
+        }
+        check(threw, "operator[] on an empty index throws out_of_range");
+    }
+    cout << "empty, " << name << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 60;
+
+    vector<int> ints = { numeric_limits<int>::min(), numeric_limits<int>::min() + 1, -1, 0, 1,
+                         numeric_limits<int>::max() - 1, numeric_limits<int>::max() };
+    testKeys(rounds, ints, "int");
+
+    vector<uint32_t> u32 = { 0, 1, 0x7FFFFFFFu, 0x80000000u, 0x80000001u, 0xFFFFFFFEu, 0xFFFFFFFFu };
+    testKeys(rounds, u32, "uint32_t");
+
+    vector<uint64_t> u64 = { 0, 1, 0xFFFFFFFFull, 0x100000000ull, 0x7FFFFFFFFFFFFFFFull, 0x8000000000000000ull,
+                             0x8000000000000001ull, 0xFFFFFFFFFFFFFFFEull, 0xFFFFFFFFFFFFFFFFull };
+    testKeys(rounds, u64, "uint64_t");
+
+    double inf = numeric_limits<double>::infinity();
+    vector<double> doubles = { -inf, -numeric_limits<double>::max(), -1.0, 0.0, numeric_limits<double>::denorm_min(),
+                               1.0, numeric_limits<double>::max(), inf };
+    testKeys(rounds, doubles, "double");
+
+    vector<int64_t> i64 = { numeric_limits<int64_t>::min(), -1, 0, 1, numeric_limits<int64_t>::max() };
+    testKeys(rounds, i64, "int64_t");
+
+    vector<string> strings = { "", "a", "aa", "b" };
+    testKeys(rounds, strings, "string");
+
+    testEmpty(0, "int");
+    testEmpty(1.0, "double");
+    testEmpty(string("a"), "string");
+
+    // keys that are not strictly increasing
+    vector< pair<int, int> > bad = { { 1, 0 }, { 3, 0 }, { 3, 0 } };
+    bool threw = false;
+    try {
+        SimdIndex<int, int> index(bad.begin(), bad.end());
+    }
+    catch (const invalid_argument&) {
+        threw = true;
+    }
+    check(threw, "repeated keys throw invalid_argument");
+
+    cout << "Failures: " << failures << endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,430 @@
+#ifndef SIMD_INDEX_H
+#define SIMD_INDEX_H
+
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+* How a SimdIndex compares a search key against one node of 16 keys.
+*
+* countLess returns how many of the node's keys are less than x. Node keys
+* are sorted, and the unused slots at the end of the index hold padding(),
+* which must not compare less than any key. The general version checks each
+* slot in turn, and tells padding apart by its rank (NIL), so any Key with
+* operator< works. The specializations below compare a whole node at once
+* with SSE2 or AVX2 compares and a movemask, and pad with the largest key,
+* so they need no rank check. Which one is used is decided at compile time
+* by the key type and the instruction set the compiler targets (-mavx2,
+* -march=native).
+*/
+template <typename Key>
+struct SimdNodeSearch
+{
+    static const bool vectorized = false;
+    static const uint32_t NIL = 0xFFFFFFFF;
+
+    static Key padding() { return Key(); }
+    static unsigned countLess(const Key* node, const uint32_t* ranks, const Key& x)
+    {
+        unsigned count = 0;
+        for (unsigned i = 0; i < 16; i++) {
+            if (ranks[i] != NIL && node[i] < x) count++;
+        }
+        return count;
+    }
+};
+
+#if defined(__SSE2__)
+
+// SSE/AVX movemasks give one bit per lane; a node's "less than" lanes are
+// always a prefix, but popcount does not rely on that
+inline unsigned simdPopcount(unsigned mask)
+{
+    return (unsigned)__builtin_popcount(mask);
+}
+
+template <>
+struct SimdNodeSearch<int>
+{
+    static const bool vectorized = true;
+    static int padding() { return std::numeric_limits<int>::max(); }
+    static unsigned countLess(const int* node, const uint32_t*, int x)
+    {
+#if defined(__AVX2__)
+        __m256i vx = _mm256_set1_epi32(x);
+        __m256i a = _mm256_load_si256((const __m256i*)node);
+        __m256i b = _mm256_load_si256((const __m256i*)(node + 8));
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(vx, a))) |
+                        ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(vx, b))) << 8);
+#else
+        __m128i vx = _mm_set1_epi32(x);
+        unsigned mask = 0;
+        for (int i = 0; i < 4; i++) {
+            __m128i v = _mm_load_si128((const __m128i*)(node + 4 * i));
+            mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, vx))) << (4 * i);
+        }
+#endif
+        return simdPopcount(mask);
+    }
+};
+
+/**
+* No unsigned compares in SSE2/AVX2: flipping the sign bit of both sides
+* turns an unsigned compare into a signed one.
+*/
+template <>
+struct SimdNodeSearch<uint32_t>
+{
+    static const bool vectorized = true;
+    static uint32_t padding() { return std::numeric_limits<uint32_t>::max(); }
+    static unsigned countLess(const uint32_t* node, const uint32_t*, uint32_t x)
+    {
+#if defined(__AVX2__)
+        __m256i bias = _mm256_set1_epi32((int)0x80000000u);
+        __m256i vx = _mm256_xor_si256(_mm256_set1_epi32((int)x), bias);
+        __m256i a = _mm256_xor_si256(_mm256_load_si256((const __m256i*)node), bias);
+        __m256i b = _mm256_xor_si256(_mm256_load_si256((const __m256i*)(node + 8)), bias);
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(vx, a))) |
+                        ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(vx, b))) << 8);
+#else
+        __m128i bias = _mm_set1_epi32((int)0x80000000u);
+        __m128i vx = _mm_xor_si128(_mm_set1_epi32((int)x), bias);
+        unsigned mask = 0;
+        for (int i = 0; i < 4; i++) {
+            __m128i v = _mm_xor_si128(_mm_load_si128((const __m128i*)(node + 4 * i)), bias);
+            mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, vx))) << (4 * i);
+        }
+#endif
+        return simdPopcount(mask);
+    }
+};
+
+template <>
+struct SimdNodeSearch<double>
+{
+    static const bool vectorized = true;
+    static double padding() { return std::numeric_limits<double>::infinity(); }
+    static unsigned countLess(const double* node, const uint32_t*, double x)
+    {
+        unsigned mask = 0;
+#if defined(__AVX2__)
+        __m256d vx = _mm256_set1_pd(x);
+        for (int i = 0; i < 4; i++) {
+            __m256d v = _mm256_load_pd(node + 4 * i);
+            mask |= (unsigned)_mm256_movemask_pd(_mm256_cmp_pd(v, vx, _CMP_LT_OQ)) << (4 * i);
+        }
+#else
+        __m128d vx = _mm_set1_pd(x);
+        for (int i = 0; i < 8; i++) {
+            __m128d v = _mm_load_pd(node + 2 * i);
+            mask |= (unsigned)_mm_movemask_pd(_mm_cmplt_pd(v, vx)) << (2 * i);
+        }
+#endif
+        return simdPopcount(mask);
+    }
+};
+
+#if defined(__SSE4_2__)
+/**
+* 64-bit integer compares need SSE4.2; without it uint64_t keys use the
+* general version.
+*/
+template <>
+struct SimdNodeSearch<uint64_t>
+{
+    static const bool vectorized = true;
+    static uint64_t padding() { return std::numeric_limits<uint64_t>::max(); }
+    static unsigned countLess(const uint64_t* node, const uint32_t*, uint64_t x)
+    {
+        unsigned mask = 0;
+#if defined(__AVX2__)
+        __m256i bias = _mm256_set1_epi64x((long long)0x8000000000000000ull);
+        __m256i vx = _mm256_xor_si256(_mm256_set1_epi64x((long long)x), bias);
+        for (int i = 0; i < 4; i++) {
+            __m256i v = _mm256_xor_si256(_mm256_load_si256((const __m256i*)(node + 4 * i)), bias);
+            mask |= (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vx, v))) << (4 * i);
+        }
+#else
+        __m128i bias = _mm_set1_epi64x((long long)0x8000000000000000ull);
+        __m128i vx = _mm_xor_si128(_mm_set1_epi64x((long long)x), bias);
+        for (int i = 0; i < 8; i++) {
+            __m128i v = _mm_xor_si128(_mm_load_si128((const __m128i*)(node + 2 * i)), bias);
+            mask |= (unsigned)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(vx, v))) << (2 * i);
+        }
+#endif
+        return simdPopcount(mask);
+    }
+};
+#endif
+
+#endif
+
+
+/**
+* A read-only search index laid out as a static 16-wide B-tree.
+*
+* Each node is 16 sorted keys, aligned to a cache line, with 17 children.
+* Nodes are numbered like an Eytzinger layout, so no child pointers are
+* stored: node k's children are nodes 17k + 1 to 17k + 17. A search reads
+* one node per level, about log17(n) of them instead of log2(n), and compares
+* all 16 keys at once (see SimdNodeSearch). As soon as the next node is known
+* it is prefetched, all of it for 8-byte keys, whose nodes span two lines.
+* Since the next node depends on the compare, prefetching cannot run whole
+* levels ahead as with a binary Eytzinger layout.
+*
+* The pairs themselves sit in one sorted array, as in FrozenMap, and each key
+* slot records its pair's position (rank), read once at the end of a search.
+*
+* Build one from a BinarySearchTree or AVLTree with
+* SimdIndex<Key, Value> index(tree.begin(), tree.end()), or from any other
+* range sorted by strictly increasing key.
+*/
+template <typename Key, typename Value>
+class SimdIndex
+{
+public:
+    typedef std::pair<const Key, Value> value_type;
+    typedef typename std::vector<value_type>::const_iterator iterator;
+    static const unsigned NODE_KEYS = 16;
+
+    SimdIndex();
+    template<typename ForwardIt>
+    SimdIndex(ForwardIt first, ForwardIt last);
+    SimdIndex(const SimdIndex<Key, Value>& other);
+    SimdIndex<Key, Value>& operator=(const SimdIndex<Key, Value>& other);
+
+    bool empty() const;
+    std::size_t size() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    typedef SimdNodeSearch<Key> Search;
+    static const uint32_t NIL = 0xFFFFFFFF;
+    static const std::size_t ALIGNMENT = 64;
+
+    void align();
+    void fill(std::size_t node, std::size_t& next);
+    std::size_t lowerBoundSlot(const Key& key) const;
+    // data(), not operator[]: a default-constructed index has no storage
+    const Key* keys() const { return storage_.data() + offset_; }
+    Key* keys() { return storage_.data() + offset_; }
+
+    std::vector<value_type> items_;
+    std::vector<Key> storage_;     // keys_, plus slack to align them
+    std::size_t offset_;           // where the aligned keys start in storage_
+    std::vector<uint32_t> ranks_;  // pair position per key slot, NIL for padding
+    std::size_t nodes_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the SimdIndex class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+SimdIndex<Key, Value>::SimdIndex() :
+    offset_(0),
+    nodes_(0)
+{
+
+}
+
+/**
+* Copies the pairs in [first, last), which must be sorted by strictly
+* increasing key, and builds the index over them in O(n). Throws
+* std::invalid_argument if the keys are not strictly increasing.
+*/
+template<class Key, class Value>
+template<typename ForwardIt>
+SimdIndex<Key, Value>::SimdIndex(ForwardIt first, ForwardIt last) :
+    offset_(0),
+    nodes_(0)
+{
+    for (ForwardIt it = first; it != last; ++it) {
+        if (!items_.empty() && !(items_.back().first < it->first)) {
+            throw std::invalid_argument("SimdIndex: keys must be strictly increasing");
+        }
+        items_.push_back(value_type(it->first, it->second));
+    }
+    if (items_.size() >= NIL) {
+        throw std::length_error("SimdIndex: too many pairs");
+    }
+
+    nodes_ = (items_.size() + NODE_KEYS - 1) / NODE_KEYS;
+    std::size_t slack = ALIGNMENT / sizeof(Key) + 1;
+    storage_.assign(nodes_ * NODE_KEYS + slack, Search::padding());
+    align();
+    ranks_.assign(nodes_ * NODE_KEYS, (uint32_t)NIL);
+
+    std::size_t next = 0;
+    fill(0, next);
+}
+
+/**
+* The keys are aligned relative to storage_'s own buffer, so a copy has to
+* find its own offset.
+*/
+template<class Key, class Value>
+SimdIndex<Key, Value>::SimdIndex(const SimdIndex<Key, Value>& other) :
+    items_(other.items_),
+    storage_(other.storage_.size(), Search::padding()),
+    offset_(0),
+    ranks_(other.ranks_),
+    nodes_(other.nodes_)
+{
+    align();
+    for (std::size_t i = 0; i < nodes_ * NODE_KEYS; i++) {
+        keys()[i] = other.keys()[i];
+    }
+}
+
+template<class Key, class Value>
+SimdIndex<Key, Value>& SimdIndex<Key, Value>::operator=(const SimdIndex<Key, Value>& other)
+{
+    if (this != &other) {
+        SimdIndex<Key, Value> copy(other);
+        items_.swap(copy.items_);
+        storage_.swap(copy.storage_);
+        std::swap(offset_, copy.offset_);
+        ranks_.swap(copy.ranks_);
+        std::swap(nodes_, copy.nodes_);
+    }
+    return *this;
+}
+
+/**
+* Sets offset_ to the first slot in the slack at the front of storage_ on a
+* cache line boundary. A key whose size does not divide into the buffer's
+* own alignment may never land on one (a 32-byte std::string in a 16-byte aligned buffer, say); those
+* keys take the general SimdNodeSearch, which needs no alignment, and start
+* at slot 0.
+*/
+template<class Key, class Value>
+void SimdIndex<Key, Value>::align()
+{
+    for (offset_ = 0; offset_ + nodes_ * NODE_KEYS < storage_.size(); offset_++) {
+        if (reinterpret_cast<uintptr_t>(storage_.data() + offset_) % ALIGNMENT == 0) return;
+    }
+    offset_ = 0;
+}
+
+/**
+* Fills the subtree at node with the next pairs in order: before each key
+* slot comes the child to its left, and the last child comes after the last
+* slot. Slots past the last pair keep their padding.
+*/
+template<class Key, class Value>
+void SimdIndex<Key, Value>::fill(std::size_t node, std::size_t& next)
+{
+    if (node >= nodes_) return;
+    for (std::size_t i = 0; i < NODE_KEYS; i++) {
+        fill(node * (NODE_KEYS + 1) + i + 1, next);
+        if (next < items_.size()) {
+            keys()[node * NODE_KEYS + i] = items_[next].first;
+            ranks_[node * NODE_KEYS + i] = (uint32_t)next;
+            next++;
+        }
+    }
+    fill(node * (NODE_KEYS + 1) + NODE_KEYS + 1, next);
+}
+
+template<class Key, class Value>
+bool SimdIndex<Key, Value>::empty() const
+{
+    return items_.empty();
+}
+
+template<class Key, class Value>
+std::size_t SimdIndex<Key, Value>::size() const
+{
+    return items_.size();
+}
+
+template<class Key, class Value>
+typename SimdIndex<Key, Value>::iterator SimdIndex<Key, Value>::begin() const
+{
+    return items_.begin();
+}
+
+template<class Key, class Value>
+typename SimdIndex<Key, Value>::iterator SimdIndex<Key, Value>::end() const
+{
+    return items_.end();
+}
+
+/**
+* The key slot of the first key not less than key, or NIL. At each node the
+* number of smaller keys picks both the child to descend into and, unless
+* all 16 are smaller, the best candidate so far.
+*/
+template<class Key, class Value>
+std::size_t SimdIndex<Key, Value>::lowerBoundSlot(const Key& key) const
+{
+    std::size_t result = NIL;
+    const Key* k = keys();
+    std::size_t node = 0;
+    while (node < nodes_) {
+        std::size_t base = node * NODE_KEYS;
+        unsigned less = Search::countLess(k + base, &ranks_[base], key);
+        std::size_t child = node * (NODE_KEYS + 1) + less + 1;
+        if (child < nodes_) {
+            const char* p = reinterpret_cast<const char*>(k + child * NODE_KEYS);
+            for (std::size_t line = 0; line < NODE_KEYS * sizeof(Key); line += ALIGNMENT) {
+                __builtin_prefetch(p + line);
+            }
+        }
+        if (less < NODE_KEYS) result = base + less;
+        node = child;
+    }
+    return result;
+}
+
+template<class Key, class Value>
+typename SimdIndex<Key, Value>::iterator SimdIndex<Key, Value>::lower_bound(const Key& key) const
+{
+    std::size_t slot = lowerBoundSlot(key);
+    if (slot == NIL || ranks_[slot] == NIL) return items_.end();
+    return items_.begin() + ranks_[slot];
+}
+
+template<class Key, class Value>
+typename SimdIndex<Key, Value>::iterator SimdIndex<Key, Value>::find(const Key& key) const
+{
+    std::size_t slot = lowerBoundSlot(key);
+    if (slot == NIL || key < keys()[slot] || ranks_[slot] == NIL) return items_.end();
+    return items_.begin() + ranks_[slot];
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value const & SimdIndex<Key, Value>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/*
+  -------------------------------------------
+  End implementations for the SimdIndex class.
+  -------------------------------------------
+*/
+
+#endif